@@ -0,0 +1,681 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "bitbuffer.h"
+#include "bitio.h"
+#include "crc.h"
+#include "crc16.h"
+#include "deframer.h"
+#include "encoder.h"
+#include "hdlc.h"
+#include "parallel_crc.h"
+#include "parallel_decoder.h"
+#include "stuffing.h"
+#include "threadpool.h"
+
+// Throughput of the framing kernels, and a differential check of each one
+// against a plain bit-at-a-time reference. Results go out as JSON.
+
+const size_t KB = size_t(1) << 10;
+const size_t GB = size_t(1) << 30;
+
+// Input sizes step by this factor from --min-size to --max-size
+const size_t SIZE_STEP = 32;
+
+enum class Pattern { RANDOM, ONES, ZEROS };
+const Pattern PATTERNS[] = {Pattern::RANDOM, Pattern::ONES, Pattern::ZEROS};
+
+static const char* pattern_name(Pattern p) {
+    switch (p) {
+    case Pattern::RANDOM: return "random";
+    case Pattern::ONES:   return "ones";
+    case Pattern::ZEROS:  return "zeros";
+    }
+    return "unknown";
+}
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--min-size SIZE] [--max-size SIZE] [--time SECONDS]"
+              << " [--check-only] [-o OUTPUT]\n"
+              << "  Measures MB/s of the CRC, stuffing, destuffing, flag scan, text\n"
+              << "  packing and end-to-end encode/decode kernels on random, all-ones\n"
+              << "  and all-zeros input, after checking them against bit-at-a-time\n"
+              << "  references (and the libhdlc calls against the kernels they\n"
+              << "  wrap). Writes JSON to OUTPUT (default stdout).\n"
+              << "  --min-size, --max-size  input sizes, with K/M/G suffixes\n"
+              << "                          (default 1K to 1G, in steps of x" << SIZE_STEP << ")\n"
+              << "  --time                  minimum time per measurement (default 0.25)\n"
+              << "  --check-only            run the differential checks only\n"
+              << "  bitcrc_encode, when it sits next to bitbench, is checked too.\n";
+}
+
+// 1K = 1024 bytes; 0 on a malformed size
+static size_t parse_size(const std::string& s) {
+    char* end = nullptr;
+    unsigned long long v = std::strtoull(s.c_str(), &end, 10);
+    std::string unit(end);
+    if (unit == "K" || unit == "k") v <<= 10;
+    else if (unit == "M" || unit == "m") v <<= 20;
+    else if (unit == "G" || unit == "g") v <<= 30;
+    else if (!unit.empty()) return 0;
+    return static_cast<size_t>(v);
+}
+
+static uint64_t next_random(uint64_t& s) {
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return s * 0x2545F4914F6CDD1DULL;
+}
+
+static BitBuffer make_bits(Pattern p, size_t nbits, uint64_t seed) {
+    BitBuffer b;
+    b.reserve(nbits);
+    uint64_t fill = p == Pattern::ONES ? ~uint64_t(0) : 0;
+    for (size_t done = 0; done < nbits; done += 64) {
+        unsigned n = static_cast<unsigned>(std::min<size_t>(64, nbits - done));
+        uint64_t w = p == Pattern::RANDOM ? next_random(seed) : fill;
+        b.append(w >> (64 - n), n);
+    }
+    return b;
+}
+
+// ---- References: one bit at a time, straight from the definitions ----
+
+static uint16_t ref_crc16(const BitSpan& bits) {
+    uint16_t reg = CRC16_INIT;
+    for (size_t i = 0; i < bits.size() + 16; ++i) {
+        unsigned b = i < bits.size() ? bits[i] : 0;
+        bool top = ((reg >> 15) ^ b) & 1;
+        reg = static_cast<uint16_t>(reg << 1);
+        if (top) reg ^= CRC16_POLY;
+    }
+    return reg;
+}
+
+// Whole bytes only: the catalogue definition through CrcEngine::check()
+template <class Spec>
+static uint64_t ref_crc_bytes(const BitSpan& bits) {
+    std::string bytes(bits.size() / 8, '\0');
+    for (size_t i = 0; i < bytes.size(); ++i)
+        bytes[i] = static_cast<char>(bits.bits(8 * i, 8));
+    return CrcEngine<Spec>::check(bytes.data(), bytes.size());
+}
+
+static BitBuffer ref_stuff(const BitSpan& in) {
+    BitBuffer out;
+    unsigned ones = 0;
+    for (size_t i = 0; i < in.size(); ++i) {
+        bool b = in[i];
+        out.push_back(b);
+        ones = b ? ones + 1 : 0;
+        if (ones == 5) {
+            out.push_back(false);
+            ones = 0;
+        }
+    }
+    return out;
+}
+
+static BitBuffer ref_destuff(const BitSpan& in) {
+    BitBuffer out;
+    unsigned ones = 0;
+    for (size_t i = 0; i < in.size(); ++i) {
+        bool b = in[i];
+        if (ones == 5) {
+            ones = 0;
+            if (!b) continue;
+        }
+        out.push_back(b);
+        ones = b ? ones + 1 : 0;
+    }
+    return out;
+}
+
+static std::vector<size_t> ref_flags(const BitSpan& in) {
+    std::vector<size_t> flags;
+    for (size_t i = 0; i + 8 <= in.size(); ++i)
+        if (in.bits(i, 8) == FLAG) flags.push_back(i);
+    return flags;
+}
+
+static BitBuffer ref_encode(const BitSpan& raw, size_t payload_bits) {
+    BitBuffer out;
+    for (size_t pos = 0; pos < raw.size(); pos += payload_bits) {
+        BitBuffer chunk;
+        chunk.append(raw.subspan(pos, std::min(payload_bits, raw.size() - pos)));
+        chunk.append(ref_crc16(chunk), 16);
+        out.append(FLAG, FLAG_BITS);
+        out.append(ref_stuff(chunk));
+        out.append(FLAG, FLAG_BITS);
+    }
+    return out;
+}
+
+static bool same(const BitSpan& a, const BitSpan& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t k = 0; k < a.word_count(); ++k)
+        if (a.word(k) != b.word(k)) return false;
+    return true;
+}
+
+// ---- Differential checks ----
+
+struct Checker {
+    size_t cases = 0;
+    std::vector<std::string> failures;
+
+    void expect(bool ok, const std::string& what) {
+        ++cases;
+        if (!ok) failures.push_back(what);
+    }
+};
+
+static std::string case_name(const char* kernel, Pattern p, size_t len, size_t offset) {
+    std::ostringstream s;
+    s << kernel << " " << pattern_name(p) << " len=" << len << " offset=" << offset;
+    return s.str();
+}
+
+static void check_kernels(Checker& c, ThreadPool& pool) {
+    const size_t lens[] = {0, 1, 7, 8, 63, 64, 65, 80, 1000, 4099, 65536 + 13, (size_t(1) << 20) + 5};
+    const size_t offsets[] = {0, 3, 61};
+    uint64_t seed = 1;
+    for (Pattern p : PATTERNS)
+        for (size_t len : lens)
+            for (size_t off : offsets) {
+                BitBuffer buf = make_bits(p, len + off, ++seed);
+                BitSpan in = buf.span(off, len);
+
+                c.expect(crc16_ccitt(in) == ref_crc16(in), case_name("crc16", p, len, off));
+                FrameCrc crc32(CrcVariant::CRC32), crc32c(CrcVariant::CRC32C);
+                c.expect(CrcEngine<Crc32c>::update(CrcEngine<Crc32c>::start(), in)
+                         == CrcEngine<Crc32c>::update_tables(CrcEngine<Crc32c>::start(), in),
+                         case_name("crc32c_accel", p, len, off));
+                if (len % 8 == 0) {
+                    c.expect(crc32.compute(in) == ref_crc_bytes<Crc32>(in), case_name("crc32", p, len, off));
+                    c.expect(crc32c.compute(in) == ref_crc_bytes<Crc32c>(in), case_name("crc32c", p, len, off));
+                }
+                // Joined from the CRCs of two parts; reflected CRCs split on a byte
+                size_t cut = len / 3 / 8 * 8;
+                BitSpan head = in.subspan(0, cut), tail = in.subspan(cut);
+                c.expect(crc16_combine(crc16_ccitt(head), crc16_ccitt(tail), tail.size())
+                         == crc16_ccitt(in), case_name("crc16_combine", p, len, off));
+                for (const FrameCrc* crc : {&crc32, &crc32c})
+                    c.expect(crc->combine(crc->compute(head), crc->compute(tail), tail.size())
+                             == crc->compute(in),
+                             case_name(crc == &crc32 ? "crc32_combine" : "crc32c_combine", p, len, off));
+                // Pieces of uneven lengths side by side, some past CRC_MANY_BITS
+                std::vector<BitSpan> parts;
+                for (size_t at = 0, k = 1; at < len && parts.size() < 20; ++k) {
+                    size_t n = std::min(len - at, k * 37 % 700);
+                    parts.push_back(in.subspan(at, n));
+                    at += n;
+                }
+                for (CrcVariant v : {CrcVariant::CRC16_CCITT, CrcVariant::CRC32, CrcVariant::CRC32C}) {
+                    FrameCrc crc(v);
+                    std::vector<uint64_t> regs(parts.size(), crc.start());
+                    crc.update_many(regs.data(), parts.data(), parts.size());
+                    bool ok = true;
+                    for (size_t k = 0; k < parts.size(); ++k)
+                        ok = ok && regs[k] == crc.update(crc.start(), parts[k]);
+                    std::string name = std::string(crc_variant_name(v)) + "_many";
+                    c.expect(ok, case_name(name.c_str(), p, len, off));
+                }
+
+                BitBuffer stuffed = bit_stuff(in);
+                c.expect(same(stuffed, ref_stuff(in)), case_name("stuff", p, len, off));
+                // The same through the streaming form, cut at an odd point
+                BitBuffer pieces;
+                StuffState st;
+                bit_stuff(in.subspan(0, len / 3), pieces, st);
+                bit_stuff(in.subspan(len / 3), pieces, st);
+                c.expect(same(pieces, stuffed), case_name("stuff_split", p, len, off));
+                c.expect(same(bit_destuff(in), ref_destuff(in)), case_name("destuff", p, len, off));
+                c.expect(same(bit_destuff(stuffed), in), case_name("destuff_roundtrip", p, len, off));
+
+                std::vector<size_t> flags;
+                scan_flags(in, 0, in.size(), flags);
+                c.expect(flags == ref_flags(in), case_name("flag_scan", p, len, off));
+
+                std::string text(len, '0'), scalar(len, '0');
+                unpack_ascii(in, &text[0]);
+                unpack_ascii_scalar(in, &scalar[0]);
+                c.expect(text == scalar, case_name("text_unpack", p, len, off));
+                // Whitespace every so often sends the packer down its slow path
+                for (size_t i = 97; i < text.size(); i += 97) text[i] = '\n';
+                BitBuffer packed, packed_scalar;
+                pack_ascii(text.data(), text.size(), packed);
+                pack_ascii_scalar(text.data(), text.size(), packed_scalar);
+                c.expect(same(packed, packed_scalar), case_name("text_pack", p, len, off));
+
+                if (len > 65536 + 13) continue;     // the references are slow
+                BitBuffer coded;
+                FrameEncoder enc;
+                enc.push(in.subspan(0, len / 2), coded);
+                enc.push(in.subspan(len / 2), coded);
+                enc.finish(coded);
+                c.expect(same(coded, ref_encode(in, FRAME_PAYLOAD_BITS)), case_name("encode", p, len, off));
+
+                BitBuffer decoded;
+                Deframer dec(decoded);
+                dec.push(coded);
+                dec.finish();
+                c.expect(same(decoded, in), case_name("decode", p, len, off));
+
+                // Corrupt a few bits: the parallel decoder must still agree
+                for (size_t i = 0; i < coded.size() / 500; ++i) {
+                    size_t at = next_random(seed) % coded.size();
+                    BitBuffer flipped;
+                    flipped.append(coded.span(0, at));
+                    flipped.push_back(!coded[at]);
+                    flipped.append(coded.span(at + 1, coded.size() - at - 1));
+                    std::swap(coded, flipped);
+                }
+                BitBuffer serial, parallel;
+                Deframer sdec(serial);
+                sdec.push(coded);
+                sdec.finish();
+                FrameCounts pc = parallel_deframe(pool, coded, parallel, nullptr);
+                const FrameCounts& sc = sdec.counts();
+                c.expect(same(serial, parallel) && pc.good == sc.good
+                         && pc.crc_errors == sc.crc_errors && pc.too_short == sc.too_short
+                         && pc.aborted == sc.aborted,
+                         case_name("decode_parallel", p, len, off));
+            }
+
+    // Large enough to be cut into slices, on a pool of its own so there are
+    // several whatever the machine
+    ThreadPool slicer(4);
+    const size_t big = 3 * PARALLEL_CRC_BITS + 13;
+    for (Pattern p : PATTERNS) {
+        BitBuffer buf = make_bits(p, big + 3, ++seed);
+        BitSpan in = buf.span(3, big);
+        for (CrcVariant v : {CrcVariant::CRC16_CCITT, CrcVariant::CRC32, CrcVariant::CRC32C}) {
+            FrameCrc crc(v);
+            std::string name = std::string(crc_variant_name(v)) + "_sliced";
+            c.expect(parallel_crc_compute(slicer, crc, in) == crc.compute(in),
+                     case_name(name.c_str(), p, big, 3));
+        }
+    }
+}
+
+// Frame decisions as seen through a handler: statuses in order, and the
+// payloads of the good frames one after another with their lengths
+struct FrameLog {
+    std::vector<FrameStatus> statuses;
+    std::vector<size_t>      lengths;
+    BitBuffer                payloads;
+
+    void add(FrameStatus status, const BitSpan& payload) {
+        statuses.push_back(status);
+        if (status == FrameStatus::OK) {
+            lengths.push_back(payload.size());
+            payloads.append(payload);
+        }
+    }
+
+    bool operator==(const FrameLog& o) const {
+        return statuses == o.statuses && lengths == o.lengths && same(payloads, o.payloads);
+    }
+};
+
+static bool same_counts(const FrameCounts& a, const FrameCounts& b) {
+    return a.good == b.good && a.too_short == b.too_short && a.crc_errors == b.crc_errors
+           && a.too_long == b.too_long && a.aborted == b.aborted;
+}
+
+// libhdlc (hdlc.h) against FrameEncoder and Deframer used directly
+static void check_hdlc(Checker& c) {
+    const size_t lens[] = {0, 1, 79, 80, 1000, 65536 + 13};
+    const size_t payloads[] = {FRAME_PAYLOAD_BITS, 13, 1500};
+    uint64_t seed = 77;
+    for (CrcVariant v : {CrcVariant::CRC16_CCITT, CrcVariant::CRC32, CrcVariant::CRC32C})
+        for (size_t len : lens)
+            for (size_t payload : payloads) {
+                std::ostringstream name;
+                name << crc_variant_name(v) << " len=" << len << " payload=" << payload;
+                BitBuffer raw = make_bits(Pattern::RANDOM, len, ++seed);
+
+                BitBuffer ref_coded;
+                FrameEncoder enc(payload, v);
+                enc.push(raw, ref_coded);
+                enc.finish(ref_coded);
+                HdlcOptions opt;
+                opt.payload_bits = payload;
+                opt.crc = v;
+                for (unsigned threads : {1u, 3u}) {
+                    opt.threads = threads;
+                    BitBuffer coded;
+                    size_t frames = hdlc_encode(raw, [&](const BitSpan& b) { coded.append(b); }, opt);
+                    c.expect(frames == enc.frames() && same(coded, ref_coded),
+                             "hdlc_encode " + name.str() + " threads=" + std::to_string(threads));
+                }
+
+                // Bit errors, and a run of seven 1s in the middle to abort a frame
+                BitBuffer coded = ref_coded;
+                for (size_t i = 0; i < coded.size() / 300; ++i) coded.flip(next_random(seed) % coded.size());
+                if (coded.size() > 200) {
+                    BitBuffer aborted;
+                    aborted.append(coded.span(0, coded.size() / 2));
+                    aborted.append(0x7F, 8);
+                    aborted.append(coded.span(coded.size() / 2, coded.size() - coded.size() / 2));
+                    std::swap(coded, aborted);
+                }
+
+                for (size_t max_frame : {size_t(0), payload + 40}) {
+                    FrameLog ref;
+                    BitBuffer out;
+                    size_t reported = 0;
+                    Deframer dec(out, v);
+                    dec.set_max_frame(max_frame);
+                    dec.on_frame = [&](FrameStatus status, size_t) {
+                        ref.add(status, out.span(reported, dec.committed() - reported));
+                        reported = dec.committed();
+                    };
+                    dec.push(coded);
+                    dec.finish();
+
+                    // Pieces of every size from a single bit up
+                    opt.threads = 1;
+                    opt.max_frame = max_frame;
+                    FrameLog got;
+                    HdlcDecoder hd([&](FrameStatus status, const BitSpan& p) { got.add(status, p); }, opt);
+                    for (size_t pos = 0, k = 0; pos < coded.size(); ++k) {
+                        size_t n = std::min(coded.size() - pos, k % 7 == 0 ? 1 : next_random(seed) % 700);
+                        hd.push(coded.span(pos, n));
+                        pos += n;
+                    }
+                    hd.finish();
+                    std::string what = name.str() + " max_frame=" + std::to_string(max_frame);
+                    c.expect(got == ref && same_counts(hd.counts(), dec.counts()),
+                             "hdlc_decoder_push " + what);
+
+                    for (unsigned threads : {1u, 3u}) {
+                        if (threads != 1 && max_frame) continue;    // whole streams keep every frame
+                        opt.threads = threads;
+                        FrameLog whole;
+                        FrameCounts counts = hdlc_decode(
+                            coded, [&](FrameStatus status, const BitSpan& p) { whole.add(status, p); }, opt);
+                        c.expect(whole == ref && same_counts(counts, dec.counts()),
+                                 "hdlc_decode " + what + " threads=" + std::to_string(threads));
+                    }
+                }
+            }
+
+    // Bytes in and out, at every length around a word
+    for (size_t nbits = 0; nbits <= 200; ++nbits) {
+        std::vector<uint8_t> bytes((nbits + 7) / 8 + 1);
+        for (uint8_t& b : bytes) b = static_cast<uint8_t>(next_random(seed));
+        BitBuffer bits = hdlc_bits_from_bytes(bytes.data(), nbits);
+        bool ok = bits.size() == nbits;
+        for (size_t i = 0; ok && i < nbits; ++i) ok = bits[i] == ((bytes[i / 8] >> (7 - i % 8)) & 1);
+        std::vector<uint8_t> back(bytes.size(), 0xA5);
+        hdlc_bytes_from_bits(bits, back.data());
+        size_t whole = nbits / 8;
+        ok = ok && std::equal(back.begin(), back.begin() + whole, bytes.begin());
+        if (nbits % 8) {
+            uint8_t mask = static_cast<uint8_t>(0xFF00 >> (nbits % 8));
+            ok = ok && (back[whole] & mask) == (bytes[whole] & mask) && !(back[whole] & ~mask);
+        }
+        ok = ok && back[(nbits + 7) / 8] == 0xA5;     // nothing written past the end
+        c.expect(ok, "hdlc_bytes nbits=" + std::to_string(nbits));
+    }
+}
+
+// ---- Tool checks ----
+
+static std::string read_file(const std::string& path) {
+    std::ifstream is(path, std::ios::binary);
+    std::ostringstream s;
+    s << is.rdbuf();
+    return s.str();
+}
+
+static void write_file(const std::string& path, const std::string& contents) {
+    std::ofstream os(path, std::ios::binary);
+    os << contents;
+}
+
+static std::string quote(const std::string& s) {
+    std::string q = "'";
+    for (char ch : s) q += ch == '\'' ? std::string("'\\''") : std::string(1, ch);
+    return q + "'";
+}
+
+// bitcrc_encode from `dir`: an input without a single bit is an error and
+// leaves an existing output file as it was
+static void check_tools(Checker& c, const std::string& dir) {
+    std::string encode = dir + "bitcrc_encode";
+    if (access(encode.c_str(), X_OK) != 0) {
+        std::cerr << "No " << encode << ", skipping the tool checks\n";
+        return;
+    }
+    char tmpl[] = "/tmp/bitbenchXXXXXX";
+    if (!mkdtemp(tmpl)) {
+        c.expect(false, "tools: cannot create a scratch directory");
+        return;
+    }
+    std::string in = std::string(tmpl) + "/in.txt", out = std::string(tmpl) + "/out";
+    const std::string old = "previous output\n";
+    auto run = [&](const char* flags) {
+        std::string cmd = quote(encode) + flags + " -i " + quote(in) + " -o " + quote(out)
+                          + " >/dev/null 2>&1";
+        return std::system(cmd.c_str());
+    };
+    for (const char* input : {"", " \n\n"})
+        for (const char* flags : {"", " -b", " -j 2"}) {
+            write_file(in, input);
+            write_file(out, old);
+            int status = run(flags);
+            c.expect(status != 0 && read_file(out) == old,
+                     std::string("encode_empty_input") + flags + (*input ? " blank" : ""));
+        }
+    // The same command does replace the output once there is something to encode
+    write_file(in, "0110\n");
+    write_file(out, old);
+    c.expect(run("") == 0 && read_file(out) != old, "encode_replaces_output");
+    unlink(in.c_str());
+    unlink(out.c_str());
+    rmdir(tmpl);
+}
+
+// ---- Timing ----
+
+struct Result {
+    std::string kernel;
+    Pattern     pattern;
+    size_t      size;       // nominal input size of the run
+    size_t      bytes;      // bytes handled per call: packed input, or text for the text kernels
+    double      best;       // fastest call, seconds
+    size_t      reps;
+};
+
+static volatile uint64_t sink;
+
+// Call `run` until `min_time` has passed (at least once) and keep the fastest
+static Result measure(const char* kernel, Pattern p, size_t size, size_t bytes,
+                      double min_time, const std::function<uint64_t()>& run) {
+    typedef std::chrono::steady_clock Clock;
+    Result r{kernel, p, size, bytes, 0, 0};
+    Clock::time_point begin = Clock::now();
+    double elapsed = 0;
+    do {
+        Clock::time_point t0 = Clock::now();
+        sink = sink + run();
+        Clock::time_point t1 = Clock::now();
+        double dt = std::chrono::duration<double>(t1 - t0).count();
+        if (r.reps == 0 || dt < r.best) r.best = dt;
+        ++r.reps;
+        elapsed = std::chrono::duration<double>(t1 - begin).count();
+    } while (elapsed < min_time);
+    return r;
+}
+
+static void bench_size(std::vector<Result>& out, Pattern p, size_t size, double min_time) {
+    const size_t nbits = 8 * size;
+    BitBuffer raw = make_bits(p, nbits, 42);
+
+    FrameCrc crcs[] = {FrameCrc(CrcVariant::CRC16_CCITT), FrameCrc(CrcVariant::CRC32),
+                       FrameCrc(CrcVariant::CRC32C)};
+    for (const FrameCrc& crc : crcs) {
+        std::string name = crc_variant_name(crc.variant());
+        out.push_back(measure(name.c_str(), p, size, size, min_time,
+                              [&]() { return crc.compute(raw); }));
+    }
+
+    {
+        BitBuffer stuffed;
+        out.push_back(measure("stuff", p, size, size, min_time, [&]() {
+            stuffed = bit_stuff(raw);
+            return stuffed.size();
+        }));
+        out.push_back(measure("destuff", p, size, stuffed.size() / 8, min_time,
+                              [&]() { return bit_destuff(stuffed).size(); }));
+    }
+
+    {
+        // Reserved up front so the buffers do not pass through a doubling at
+        // the largest sizes; all-ones input codes to about 1.64x
+        BitBuffer coded;
+        coded.reserve(2 * nbits);
+        out.push_back(measure("encode", p, size, size, min_time, [&]() {
+            coded.clear();
+            FrameEncoder enc;
+            enc.push(raw, coded);
+            enc.finish(coded);
+            return enc.frames();
+        }));
+        // A flag position per 40 coded bits would outgrow the input, so the
+        // scan goes a region at a time as in the parallel decoder
+        out.push_back(measure("flag_scan", p, size, coded.size() / 8, min_time, [&]() {
+            const size_t region = size_t(1) << 20;
+            std::vector<size_t> flags;
+            uint64_t found = 0;
+            for (size_t at = 0; at < coded.size(); at += region) {
+                flags.clear();
+                scan_flags(coded, at, at + region, flags);
+                found += flags.size();
+            }
+            return found;
+        }));
+        out.push_back(measure("decode", p, size, coded.size() / 8, min_time, [&]() {
+            BitBuffer decoded;
+            decoded.reserve(nbits + 4096);      // the last frame's CRC and flag pass through
+            Deframer dec(decoded);
+            dec.push(coded);
+            dec.finish();
+            return dec.frames();
+        }));
+    }
+
+    // Text kernels take `size` characters, so they stay within memory at
+    // the largest sizes too
+    raw = make_bits(p, size, 42);
+    std::string text(size, '0');
+    out.push_back(measure("text_unpack", p, size, size, min_time, [&]() {
+        unpack_ascii(raw, &text[0]);
+        return static_cast<uint64_t>(text[size / 2]);
+    }));
+    out.push_back(measure("text_pack", p, size, size, min_time, [&]() {
+        BitBuffer packed;
+        pack_ascii(text.data(), text.size(), packed);
+        return packed.size();
+    }));
+}
+
+// ---- Output ----
+
+static std::string json_string(const std::string& s) {
+    std::string r = "\"";
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\') r += '\\';
+        r += ch;
+    }
+    return r + "\"";
+}
+
+static void write_json(std::ostream& os, const Checker& c, const std::vector<Result>& results) {
+    os << "{\n"
+       << "  \"engines\": {\"crc16\": " << json_string(crc16_engine_name())
+       << ", \"crc32c_sse42\": " << (crc32c_have_sse42() ? "true" : "false")
+       << ", \"text\": " << json_string(bitio_engine_name()) << "},\n"
+       << "  \"check\": {\"cases\": " << c.cases << ", \"passed\": "
+       << (c.failures.empty() ? "true" : "false") << ", \"failures\": [";
+    for (size_t i = 0; i < c.failures.size(); ++i)
+        os << (i ? ", " : "") << json_string(c.failures[i]);
+    os << "]},\n"
+       << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        char rate[32];
+        std::snprintf(rate, sizeof rate, "%.1f", r.bytes / r.best / 1e6);
+        os << (i ? ",\n" : "\n")
+           << "    {\"kernel\": " << json_string(r.kernel)
+           << ", \"pattern\": " << json_string(pattern_name(r.pattern))
+           << ", \"size\": " << r.size << ", \"bytes\": " << r.bytes
+           << ", \"reps\": " << r.reps << ", \"best_s\": " << r.best
+           << ", \"mb_per_s\": " << rate << "}";
+    }
+    os << (results.empty() ? "]\n" : "\n  ]\n") << "}\n";
+}
+
+int main(int argc, char** argv) {
+    size_t min_size = KB, max_size = GB;
+    double min_time = 0.25;
+    bool check_only = false;
+    std::string out_path = "-";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--min-size" && i + 1 < argc) min_size = parse_size(argv[++i]);
+        else if (arg == "--max-size" && i + 1 < argc) max_size = parse_size(argv[++i]);
+        else if (arg == "--time" && i + 1 < argc) min_time = std::strtod(argv[++i], nullptr);
+        else if (arg == "--check-only") check_only = true;
+        else if (arg == "-o" && i + 1 < argc) out_path = argv[++i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (min_size == 0 || max_size < min_size) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Checker checker;
+    ThreadPool pool(2);
+    check_kernels(checker, pool);
+    check_hdlc(checker);
+    std::string self = argv[0];
+    check_tools(checker, self.substr(0, self.rfind('/') + 1));
+    for (const std::string& f : checker.failures) std::cerr << "MISMATCH " << f << "\n";
+
+    std::vector<Result> results;
+    if (!check_only && checker.failures.empty())
+        for (size_t size = min_size; size <= max_size; size *= SIZE_STEP)
+            for (Pattern p : PATTERNS) {
+                std::cerr << "Measuring " << pattern_name(p) << " " << size << " bytes\n";
+                bench_size(results, p, size, min_time);
+            }
+
+    if (out_path == "-") {
+        write_json(std::cout, checker, results);
+    } else {
+        std::ofstream os(out_path);
+        write_json(os, checker, results);
+        if (!os) {
+            std::cerr << "Write to " << out_path << " failed.\n";
+            return 1;
+        }
+    }
+    return checker.failures.empty() ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+// bitbuffer.h
+#ifndef BITBUFFER_H
+#define BITBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Bits are stored MSB-first in 64-bit words: stream bit i lives in
+// word i/64 at bit position 63 - i%64. This keeps the stream order equal to
+// polynomial order, so CRC engines and shift-based kernels can work on
+// whole words without reshuffling.
+
+// Low `n` bits set, valid for n in [0, 64]
+inline uint64_t low_mask(unsigned n) {
+    return n >= 64 ? ~uint64_t(0) : ((uint64_t(1) << n) - 1);
+}
+
+// Read-only view of a bit range that may start at any bit offset
+class BitSpan {
+public:
+    BitSpan() : words_(nullptr), offset_(0), size_(0) {}
+    BitSpan(const uint64_t* words, size_t offset, size_t size)
+        : words_(words + offset / 64), offset_(offset % 64), size_(size) {}
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    bool operator[](size_t i) const {
+        size_t p = offset_ + i;
+        return (words_[p >> 6] >> (63 - (p & 63))) & 1;
+    }
+
+    // `n` bits starting at `pos`, right-aligned (n in [1, 64], pos + n <= size)
+    uint64_t bits(size_t pos, unsigned n) const {
+        return raw_word(pos) >> (64 - n);
+    }
+
+    // Number of 64-bit words needed to cover the span
+    size_t word_count() const { return (size_ + 63) / 64; }
+
+    // k-th 64-bit word of the span, MSB-first; bits past the end read as zero
+    uint64_t word(size_t k) const {
+        size_t pos = k * 64;
+        uint64_t w = raw_word(pos);
+        size_t left = size_ - pos;
+        if (left < 64) w &= ~low_mask(static_cast<unsigned>(64 - left));
+        return w;
+    }
+
+    // True when the span starts on a word boundary and word(k) == words()[k]
+    bool aligned() const { return offset_ == 0; }
+    const uint64_t* words() const { return words_; }
+    size_t offset() const { return offset_; }
+
+    BitSpan subspan(size_t pos, size_t len) const {
+        return BitSpan(words_, offset_ + pos, len);
+    }
+    BitSpan subspan(size_t pos) const { return subspan(pos, size_ - pos); }
+
+private:
+    const uint64_t* words_;
+    size_t offset_;     // always < 64
+    size_t size_;
+
+    // 64 bits starting at span bit `pos`; never reads past the last word the
+    // span touches, the bits beyond the span end are unspecified
+    uint64_t raw_word(size_t pos) const {
+        size_t p  = offset_ + pos;
+        size_t w  = p >> 6;
+        unsigned sh = p & 63;
+        uint64_t hi = words_[w] << sh;
+        if (sh && (w + 1) * 64 < offset_ + size_)
+            hi |= words_[w + 1] >> (64 - sh);
+        return hi;
+    }
+};
+
+// Growable bit container backed by 64-bit words. Bits past size() in the last
+// word are kept zero so appends can simply OR into it.
+class BitBuffer {
+public:
+    BitBuffer() : size_(0) {}
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t word_count() const { return words_.size(); }
+    const uint64_t* data() const { return words_.data(); }
+
+    void clear() { words_.clear(); size_ = 0; }
+    void reserve(size_t nbits) { words_.reserve((nbits + 63) / 64); }
+
+    bool operator[](size_t i) const {
+        return (words_[i >> 6] >> (63 - (i & 63))) & 1;
+    }
+
+    void flip(size_t i) { words_[i >> 6] ^= uint64_t(1) << (63 - (i & 63)); }
+
+    void push_back(bool b) {
+        unsigned used = size_ & 63;
+        if (used == 0) words_.push_back(0);
+        if (b) words_[size_ >> 6] |= uint64_t(1) << (63 - used);
+        ++size_;
+    }
+
+    // Append the low `n` bits of `v`, most significant of them first (n <= 64)
+    void append(uint64_t v, unsigned n) {
+        if (n == 0) return;
+        v &= low_mask(n);
+        unsigned used = size_ & 63;
+        if (used == 0) {
+            words_.push_back(v << (64 - n));
+        } else {
+            unsigned room = 64 - used;
+            uint64_t& last = words_[size_ >> 6];
+            if (n <= room) {
+                last |= v << (room - n);
+            } else {
+                last |= v >> (n - room);
+                words_.push_back(v << (64 - (n - room)));
+            }
+        }
+        size_ += n;
+    }
+
+    void append(const BitSpan& s) {
+        size_t n = s.size();
+        if (n == 0) return;
+        if ((size_ & 63) == 0 && s.aligned()) {
+            size_t nw = s.word_count();
+            size_t at = words_.size();
+            words_.resize(at + nw);
+            std::memcpy(&words_[at], s.words(), nw * sizeof(uint64_t));
+            size_ += n;
+            truncate(size_);    // clear whatever followed the span in its last word
+            return;
+        }
+        size_t full = n / 64;
+        for (size_t k = 0; k < full; ++k) append(s.word(k), 64);
+        unsigned rest = n & 63;
+        if (rest) append(s.word(full) >> (64 - rest), rest);
+    }
+
+    // Drop everything past the first `nbits` bits
+    void truncate(size_t nbits) {
+        if (nbits > size_) return;
+        size_ = nbits;
+        words_.resize((nbits + 63) / 64);
+        if (nbits & 63) words_.back() &= ~low_mask(static_cast<unsigned>(64 - (nbits & 63)));
+    }
+
+    // Copy `len` bits from `src` back to `dst` <= `src`, closing a gap
+    // inside the buffer; the bits at the old place are left as they were
+    void move_down(size_t dst, size_t src, size_t len) {
+        for (size_t k = 0; k < len; k += 64) {
+            unsigned n = len - k < 64 ? static_cast<unsigned>(len - k) : 64;
+            uint64_t keep = ~low_mask(64 - n);          // top n bits
+            uint64_t v = span(src + k, n).word(0);
+            size_t at = dst + k, w = at >> 6;
+            unsigned sh = at & 63;
+            words_[w] = (words_[w] & ~(keep >> sh)) | (v >> sh);
+            if (sh + n > 64)
+                words_[w + 1] = (words_[w + 1] & ~(keep << (64 - sh))) | (v << (64 - sh));
+        }
+    }
+
+    BitSpan span() const { return BitSpan(words_.data(), 0, size_); }
+    BitSpan span(size_t pos, size_t len) const { return BitSpan(words_.data(), pos, len); }
+    operator BitSpan() const { return span(); }
+
+private:
+    std::vector<uint64_t> words_;
+    size_t size_;
+};
+
+#endif // BITBUFFER_H
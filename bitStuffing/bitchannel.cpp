@@ -0,0 +1,202 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "bitbuffer.h"
+#include "bitio.h"
+#include "channel.h"
+#include "container.h"
+#include "deframer.h"
+#include "encoder.h"
+#include "pipeline.h"
+#include "threadpool.h"
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--ber P] [--burst TO_BAD TO_GOOD] [--bad-ber P]"
+              << " [--seed N] [-i INPUT] [-o OUTPUT]\n"
+              << "       " << prog << " --sweep RATES [--burst TO_BAD TO_GOOD] [--bad-ber P]"
+              << " [--seed N] [-j THREADS] [--crc NAME] [--payload BITS] [-i INPUT]\n"
+              << "  Passes a bit stream through a noisy channel. INPUT/OUTPUT default\n"
+              << "  to stdin/stdout ('-'); the output keeps the input's format.\n"
+              << "  --ber      probability of a bit error (in the good state with --burst).\n"
+              << "  --burst    Gilbert-Elliott bursts: per-bit probability of moving from\n"
+              << "             the good state to the bad one and back.\n"
+              << "  --bad-ber  probability of a bit error in the bad state (default 0.5).\n"
+              << "  --seed     seed of the error pattern (default 1).\n"
+              << "  --sweep    encode INPUT (default stream.txt), then for each of the\n"
+              << "             comma-separated RATES corrupt and decode it, and print frame\n"
+              << "             loss and goodput. RATES are bit error rates, or TO_BAD\n"
+              << "             with --burst. The runs share -j THREADS (0: one per core,\n"
+              << "             default 1); results do not depend on it.\n"
+              << "  --crc, --payload  framing for --sweep, as in bitcrc_encode.\n";
+}
+
+// One rate of a sweep
+struct SweepPoint {
+    double      rate;
+    uint64_t    errors;
+    FrameCounts counts;
+    size_t      delivered;      // payload bits out of the decoder
+};
+
+static bool parse_rates(const std::string& s, std::vector<double>& rates) {
+    std::istringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        char* end;
+        double r = std::strtod(item.c_str(), &end);
+        if (item.empty() || *end || r < 0 || r > 1) return false;
+        rates.push_back(r);
+    }
+    return !rates.empty();
+}
+
+// Encode once, then corrupt and decode a copy per rate on the pool. Each
+// run's errors come from channel_seed(seed, its index), so the table is
+// the same for any number of threads.
+static int sweep(const std::string& in_path, const std::vector<double>& rates,
+                 const ChannelParams& base, uint64_t seed, unsigned threads,
+                 size_t payload_bits, CrcVariant crc) {
+    bool malformed;
+    BitBuffer raw = load_bits(in_path, nullptr, &malformed);
+    if (malformed) {
+        std::cerr << "Malformed container in " << in_path << "\n";
+        return 1;
+    }
+    if (raw.empty()) {
+        std::cerr << "Input stream is empty.\n";
+        return 1;
+    }
+    BitBuffer coded;
+    FrameEncoder encoder(payload_bits, crc);
+    coded.reserve(encoder.output_bound(raw.size()));
+    encoder.push(raw, coded);
+    encoder.finish(coded);
+    const size_t sent = encoder.frames();
+
+    ThreadPool pool(threads);
+    ReorderBuffer<SweepPoint> done;
+    for (size_t k = 0; k < rates.size(); ++k) {
+        pool.submit([&, k]() {
+            ChannelParams params = base;
+            if (params.burst) params.to_bad = rates[k];
+            else params.ber = rates[k];
+            BitBuffer noisy;
+            noisy.append(coded.span());
+            Channel channel(params, channel_seed(seed, k));
+            channel.apply(noisy);
+            BitBuffer decoded;
+            Deframer deframer(decoded, crc);
+            deframer.push(noisy);
+            deframer.finish();
+            SweepPoint p;
+            p.rate = rates[k];
+            p.errors = channel.errors();
+            p.counts = deframer.counts();
+            p.delivered = deframer.committed();
+            done.put(k, p);
+        });
+    }
+
+    std::printf("%-12s %12s %10s %10s %10s %10s %10s %10s\n", base.burst ? "to_bad" : "ber",
+                "bit_errors", "frames", "good", "crc_err", "dropped", "loss", "goodput");
+    for (size_t k = 0; k < rates.size(); ++k) {
+        SweepPoint p = done.take();
+        // Errors can split a frame in two, so `good` may even exceed `sent`
+        double loss = p.counts.good < sent ? 1.0 - double(p.counts.good) / double(sent) : 0.0;
+        std::printf("%-12g %12llu %10zu %10zu %10zu %10zu %10.6f %10.6f\n", p.rate,
+                    static_cast<unsigned long long>(p.errors), sent, p.counts.good,
+                    p.counts.crc_errors, p.counts.bad(), loss,
+                    double(p.delivered) / double(coded.size()));
+        std::fflush(stdout);
+    }
+    return 0;
+}
+
+static int pass_through(const std::string& in_path, const std::string& out_path,
+                        const ChannelParams& params, uint64_t seed) {
+    int in = open_input(in_path);
+    if (in < 0) {
+        std::cerr << "Cannot open " << in_path << "\n";
+        return 1;
+    }
+    int out = open_output(out_path);
+    if (out < 0) {
+        std::cerr << "Cannot open " << out_path << "\n";
+        return 1;
+    }
+    int status = 0;
+    {
+        ReadStage read_ahead(in);
+        WriteStage write_behind(out);
+        BitInput reader(in);
+        if (reader.ok()) {
+            reader.set_source(&read_ahead);
+            BitOutput writer(out, reader.binary(), reader.header());
+            writer.set_sink(&write_behind);
+            Channel channel(params, seed);
+            BitBuffer block;
+            while (reader.read(block)) {
+                channel.apply(block);
+                writer.write(block);
+            }
+            writer.finish();
+            if (!writer.ok()) {
+                std::cerr << "Write to " << out_path << " failed.\n";
+                status = 1;
+            } else {
+                std::cerr << "Flipped " << channel.errors() << " of " << channel.bits()
+                          << " bits.\n";
+            }
+        }
+        if (!reader.ok()) {
+            std::cerr << "Malformed container in " << in_path << "\n";
+            status = 1;
+        }
+    }
+    if (in != STDIN_FILENO) close(in);
+    if (out != STDOUT_FILENO) close(out);
+    return status;
+}
+
+int main(int argc, char** argv) {
+    ChannelParams params;
+    uint64_t seed = 1;
+    std::vector<double> rates;
+    unsigned threads = 1;
+    size_t payload_bits = FRAME_PAYLOAD_BITS;
+    CrcVariant crc = CrcVariant::CRC16_CCITT;
+    std::string in_path, out_path = "-";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--ber" && i + 1 < argc) params.ber = std::strtod(argv[++i], nullptr);
+        else if (arg == "--burst" && i + 2 < argc) {
+            params.burst = true;
+            params.to_bad = std::strtod(argv[++i], nullptr);
+            params.to_good = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--bad-ber" && i + 1 < argc) params.bad_ber = std::strtod(argv[++i], nullptr);
+        else if (arg == "--seed" && i + 1 < argc) seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--sweep" && i + 1 < argc && parse_rates(argv[i + 1], rates)) ++i;
+        else if ((arg == "-j" || arg == "--threads") && i + 1 < argc)
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--crc" && i + 1 < argc && parse_crc_variant(argv[i + 1], crc)) ++i;
+        else if (arg == "--payload" && i + 1 < argc && std::strtoull(argv[i + 1], nullptr, 10) > 0)
+            payload_bits = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "-i" && i + 1 < argc) in_path = argv[++i];
+        else if (arg == "-o" && i + 1 < argc) out_path = argv[++i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!rates.empty())
+        return sweep(in_path.empty() ? "stream.txt" : in_path, rates, params, seed, threads,
+                     payload_bits, crc);
+    return pass_through(in_path.empty() ? "-" : in_path, out_path, params, seed);
+}
@@ -0,0 +1,74 @@
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+#include "bitbuffer.h"
+#include "bitio.h"
+#include "container.h"
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [-i INPUT] [-o OUTPUT] [--coded] [--frame-bits N]\n"
+              << "  Converts '0'/'1' text to the packed container format and back;\n"
+              << "  the direction follows from the input. INPUT/OUTPUT default to\n"
+              << "  stdin/stdout ('-').\n"
+              << "  --coded       mark the container as a framed stream (default raw)\n"
+              << "  --frame-bits  payload bits per frame to record in the header\n";
+}
+
+int main(int argc, char** argv) {
+    std::string in_path = "-", out_path = "-";
+    ContainerHeader header;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-i" && i + 1 < argc) in_path = argv[++i];
+        else if (arg == "-o" && i + 1 < argc) out_path = argv[++i];
+        else if (arg == "--coded") header.kind = StreamKind::CODED;
+        else if (arg == "--frame-bits" && i + 1 < argc)
+            header.frame_bits = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    int in = open_input(in_path);
+    if (in < 0) {
+        std::cerr << "Cannot open " << in_path << "\n";
+        return 1;
+    }
+    int out = open_output(out_path);
+    if (out < 0) {
+        std::cerr << "Cannot open " << out_path << "\n";
+        return 1;
+    }
+
+    BitInput reader(in);
+    if (!reader.ok()) {
+        std::cerr << "Malformed container in " << in_path << "\n";
+        return 1;
+    }
+    // Text becomes a container, a container becomes text
+    BitOutput writer(out, !reader.binary(), header);
+    BitBuffer block;
+    uint64_t total = 0;
+    while (reader.read(block)) {
+        total += block.size();
+        writer.write(block);
+    }
+    writer.finish();
+
+    if (in != STDIN_FILENO) close(in);
+    if (out != STDOUT_FILENO) close(out);
+    if (!reader.ok()) {
+        std::cerr << "Malformed container in " << in_path << "\n";
+        return 1;
+    }
+    if (!writer.ok()) {
+        std::cerr << "Write to " << out_path << " failed.\n";
+        return 1;
+    }
+    std::cerr << "Converted " << total << " bits to "
+              << (reader.binary() ? "text" : "container") << ".\n";
+    return 0;
+}
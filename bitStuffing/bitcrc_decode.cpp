@@ -1,117 +1,245 @@
 #include <iostream>
+#include <string>
 #include <vector>
-#include <fstream>
 #include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bitbuffer.h"
+#include "bitio.h"
+#include "container.h"
+#include "deframer.h"
+#include "parallel_decoder.h"
+#include "pipeline.h"
+#include "stats.h"
 
-const std::vector<bool> FLAG = {0,1,1,1,1,1,1,0};
+// Longest destuffed frame kept in streaming mode before it is dropped
+const size_t STREAM_MAX_FRAME = size_t(1) << 26;
 
-// CRC-16-CCITT (poly 0x1021, init 0xFFFF)
-uint16_t crc16_ccitt(const std::vector<bool>& bits) {
-    uint16_t crc = 0xFFFF;
-    for (bool bit : bits) {
-        bool msb = (crc >> 15) & 1;
-        crc <<= 1;
-        if (bit ^ msb) crc ^= 0x1021;
-    }
-    for (int i = 0; i < 16; ++i) {
-        bool msb = (crc >> 15) & 1;
-        crc <<= 1;
-        if (msb) crc ^= 0x1021;
-    }
-    return crc;
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [-s|--stream] [-b|--binary] [-j THREADS]"
+              << " [--crc NAME] [-i INPUT] [-o OUTPUT] [--max-frame BITS]"
+              << " [--stats] [--progress SECONDS]\n"
+              << "  Reads codedStream.txt and writes decodedStream.txt by default, block\n"
+              << "  by block, reading ahead and writing behind on threads of their own\n"
+              << "  while decoding.\n"
+              << "  --stream     INPUT/OUTPUT default to stdin/stdout ('-'), and frames\n"
+              << "               are limited to --max-frame bits.\n"
+              << "  --binary     write the packed container format (decodedStream.bin).\n"
+              << "  -j           decode on THREADS threads (0: one per core, default 1),\n"
+              << "               with the whole stream in memory; the output and\n"
+              << "               messages are the same as with one.\n"
+              << "               Not available with --stream.\n"
+              << "  --crc        frame check sequence: crc16, crc32, crc32c. Defaults\n"
+              << "               to the one in a container header, else crc16.\n"
+              << "  --max-frame  in streaming mode, drop frames longer than BITS\n"
+              << "               (default " << STREAM_MAX_FRAME << ").\n"
+              << "  --stats      print a JSON line of timings, counts and the CRC\n"
+              << "               failure rate to stderr at exit.\n"
+              << "  --progress   print a progress line to stderr every SECONDS.\n"
+              << "  INPUT may be '0'/'1' text or a container; it is detected.\n";
 }
 
-// Remove any 0 following five consecutive 1s
-std::vector<bool> bit_destuff(const std::vector<bool>& in) {
-    std::vector<bool> out;
-    int ones = 0;
-    for (size_t i = 0; i < in.size(); ++i) {
-        bool b = in[i];
-        if (b) {
-            if (++ones == 5) {
-                // skip the next bit if it's a stuffed '0'
-                if (i + 1 < in.size() && in[i+1] == false) ++i;
-                ones = 0;
-            }
-        } else {
-            ones = 0;
-        }
-        out.push_back(b);
-    }
-    return out;
+// CRC to check frames with: the one given with --crc, else the header's
+static bool pick_crc(const ContainerHeader& in, const std::string& in_path,
+                     bool forced, CrcVariant& crc) {
+    if (forced) return true;
+    crc = in.crc;
+    if (crc_variant_known(crc)) return true;
+    std::cerr << "Unsupported CRC variant " << static_cast<unsigned>(in.crc)
+              << " in " << in_path << "\n";
+    return false;
 }
 
-// Read '0'/'1' chars from a file into a bit vector
-std::vector<bool> read_bitfile(const std::string& path) {
-    std::ifstream fin(path);
-    std::vector<bool> bits;
-    char c;
-    while (fin >> c) {
-        if (c=='0' || c=='1') bits.push_back(c=='1');
-    }
-    return bits;
+static ContainerHeader raw_header(const ContainerHeader& in, CrcVariant crc) {
+    ContainerHeader h;
+    h.kind = StreamKind::RAW;
+    h.crc = crc;
+    h.frame_bits = in.frame_bits;
+    return h;
 }
 
-// Write '0'/'1' chars to a file
-void write_bitfile(const std::string& path, const std::vector<bool>& bits) {
-    std::ofstream fout(path);
-    for (bool b : bits) fout << (b ? '1' : '0');
+static void report(FrameStatus status, size_t frames) {
+    if (status == FrameStatus::TOO_SHORT)
+        std::cerr << "Frame " << frames << " too short.\n";
+    else if (status == FrameStatus::CRC_MISMATCH)
+        std::cerr << "CRC mismatch in frame " << frames << "\n";
+    else if (status == FrameStatus::TOO_LONG)
+        std::cerr << "Frame " << frames << " too long, dropped.\n";
+    else if (status == FrameStatus::ABORTED)
+        std::cerr << "Frame " << frames << " aborted (seven 1s in a row).\n";
 }
 
-bool match_flag(const std::vector<bool>& v, size_t pos) {
-    if (pos + FLAG.size() > v.size()) return false;
-    for (size_t i = 0; i < FLAG.size(); ++i)
-        if (v[pos+i] != FLAG[i]) return false;
-    return true;
+static void count_frames(const FrameCounts& counts) {
+    stats_set(Stat::FRAMES, counts.good);
+    stats_set(Stat::BAD_FRAMES, counts.bad());
+    stats_set(Stat::CRC_ERRORS, counts.crc_errors);
 }
 
-int main() {
-    auto coded = read_bitfile("codedStream.txt");
-    std::vector<bool> output_data;
-    int frames = 0;
-
-    size_t i = 0;
-    while (i + FLAG.size() <= coded.size()) {
-        // find opening flag
-        if (!match_flag(coded, i)) { ++i; continue; }
-        size_t start = i + FLAG.size();
-        size_t j = start;
-        while (j + FLAG.size() <= coded.size() && !match_flag(coded, j)) {
-            ++j;
-        }
-        if (j + FLAG.size() > coded.size()) {
-            ++i;
-            continue;
-        }
+// Size of a named file, for --stats where no pipeline stage counted the output
+static uint64_t file_bytes(const std::string& path) {
+    struct stat st;
+    return path != "-" && stat(path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
 
-        std::vector<bool> stuffed(coded.begin() + start, coded.begin() + j);
-        auto deframed = bit_destuff(stuffed);
+static void summary(std::ostream& log, const FrameCounts& counts) {
+    log << "Decoded " << counts.good << " frames.\n";
+    if (counts.bad() == 0) return;
+    log << "Dropped " << counts.bad() << " frames: " << counts.crc_errors << " CRC mismatch, "
+        << counts.too_short << " too short, " << counts.aborted << " aborted, "
+        << counts.too_long << " too long.\n";
+}
 
-        if (deframed.size() < 16) {
-            std::cerr << "Frame " << frames << " too short.\n";
-            ++i;
-            continue;
-        }
+// Decode block by block; decoded data is written out as soon as its frame
+// checks out, so memory is bounded by the block size and the frame limit.
+// This thread only decodes: the input is read ahead and the output written
+// behind by the pipeline stages.
+static int decode_fds(int in, int out, const std::string& in_path, const std::string& out_path,
+                      size_t max_frame, bool binary, bool forced, CrcVariant crc,
+                      std::ostream& log) {
+    ReadStage read_ahead(in);
+    WriteStage write_behind(out);
+    BitInput reader(in);
+    if (!reader.ok()) {
+        std::cerr << "Malformed container in " << in_path << "\n";
+        return 1;
+    }
+    if (!pick_crc(reader.header(), in_path, forced, crc)) return 1;
+    reader.set_source(&read_ahead);
+    BitOutput writer(out, binary, raw_header(reader.header(), crc));
+    writer.set_sink(&write_behind);
+    BitBuffer block, decoded;
+    Deframer deframer(decoded, crc);
+    deframer.on_frame = report;
+    deframer.set_max_frame(max_frame);
+    while (reader.read(block)) {
+        stats_add(Stat::BITS_IN, block.size());
+        deframer.push(block);
+        stats_add(Stat::BITS_OUT, deframer.committed());
+        writer.write(decoded.span(0, deframer.committed()));
+        deframer.discard_committed();
+        count_frames(deframer.counts());
+    }
+    deframer.finish();
+    stats_add(Stat::BITS_OUT, decoded.size());
+    writer.write(decoded);
+    writer.finish();
+    count_frames(deframer.counts());
 
-        std::vector<bool> data(deframed.begin(), deframed.end() - 16);
-        uint16_t recv_crc = 0;
-        for (size_t k = deframed.size() - 16; k < deframed.size(); ++k)
-            recv_crc = (recv_crc << 1) | (deframed[k] ? 1 : 0);
-
-        uint16_t calc_crc = crc16_ccitt(data);
-        if (calc_crc != recv_crc) {
-            std::cerr << "CRC mismatch in frame " << frames << "\n";
-            ++i;
-            continue;
-        } else {
-            output_data.insert(output_data.end(), data.begin(), data.end());
-            ++frames;
-        }
+    if (!reader.ok()) {
+        std::cerr << "Malformed container in " << in_path << "\n";
+        return 1;
+    }
+    if (!writer.ok()) {
+        std::cerr << "Write to " << out_path << " failed.\n";
+        return 1;
+    }
+    summary(log, deframer.counts());
+    return 0;
+}
+
+static int decode_stream(const std::string& in_path, const std::string& out_path,
+                         size_t max_frame, bool binary, bool forced, CrcVariant crc,
+                         std::ostream& log) {
+    int in = open_input(in_path);
+    if (in < 0) {
+        std::cerr << "Cannot open " << in_path << "\n";
+        return 1;
+    }
+    int out = open_output(out_path);
+    if (out < 0) {
+        std::cerr << "Cannot open " << out_path << "\n";
+        return 1;
+    }
+    int status = decode_fds(in, out, in_path, out_path, max_frame, binary, forced, crc, log);
+    if (in != STDIN_FILENO) close(in);
+    if (out != STDOUT_FILENO) close(out);
+    return status;
+}
 
-        i = j + FLAG.size();
+// -j: the whole stream in memory, split between the pool's threads
+static int decode_whole(const std::string& in_path, const std::string& out_path, unsigned threads,
+                        bool binary, bool forced, CrcVariant crc, std::ostream& log) {
+    ContainerHeader header;
+    bool malformed;
+    BitBuffer coded;
+    {
+        StatClock reading(Stat::READ_NS), idle(Stat::WAIT_NS);
+        coded = load_bits(in_path, &header, &malformed);
+    }
+    if (malformed) {
+        std::cerr << "Malformed container in " << in_path << "\n";
+        return 1;
     }
+    if (!pick_crc(header, in_path, forced, crc)) return 1;
+    BitBuffer output_data;
 
-    write_bitfile("decodedStream.txt", output_data);
-    std::cout << "Decoded " << frames << " frames.\n";
+    ThreadPool pool(threads);
+    FrameCounts counts = parallel_deframe(pool, coded, output_data, report, crc);
+    stats_add(Stat::BITS_IN, coded.size());
+    stats_add(Stat::BITS_OUT, output_data.size());
+    count_frames(counts);
+
+    bool written;
+    {
+        StatClock writing(Stat::WRITE_NS), idle(Stat::WAIT_NS);
+        written = save_bits(out_path, output_data, binary, raw_header(header, crc),
+                            std::vector<uint64_t>());
+    }
+    if (!written) {
+        std::cerr << "Write to " << out_path << " failed.\n";
+        return 1;
+    }
+    stats_add(Stat::BYTES_OUT, file_bytes(out_path));
+    summary(log, counts);
     return 0;
 }
+
+int main(int argc, char** argv) {
+    bool stream = false, binary = false, forced = false;
+    unsigned threads = 1;
+    CrcVariant crc = CrcVariant::CRC16_CCITT;
+    size_t max_frame = STREAM_MAX_FRAME;
+    bool stats = false;
+    double progress = 0;
+    std::string in_path, out_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-s" || arg == "--stream") stream = true;
+        else if (arg == "-b" || arg == "--binary") binary = true;
+        else if ((arg == "-j" || arg == "--threads") && i + 1 < argc)
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--crc" && i + 1 < argc && parse_crc_variant(argv[i + 1], crc))
+            forced = true, ++i;
+        else if (arg == "-i" && i + 1 < argc) in_path = argv[++i];
+        else if (arg == "-o" && i + 1 < argc) out_path = argv[++i];
+        else if (arg == "--max-frame" && i + 1 < argc) max_frame = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--stats") stats = true;
+        else if (arg == "--progress" && i + 1 < argc) progress = std::strtod(argv[++i], nullptr);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (in_path.empty()) in_path = stream ? "-" : "codedStream.txt";
+    if (out_path.empty())
+        out_path = stream ? "-" : binary ? "decodedStream.bin" : "decodedStream.txt";
+
+    if (stream && threads != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::ostream& log = stream || out_path == "-" ? std::cerr : std::cout;
+    int status;
+    {
+        StatsProgress ticker("bitcrc_decode", progress);
+        // Whole files keep every frame, however long
+        if (stream || threads == 1)
+            status = decode_stream(in_path, out_path, stream ? max_frame : 0, binary, forced, crc,
+                                   log);
+        else
+            status = decode_whole(in_path, out_path, threads, binary, forced, crc, log);
+    }
+    if (stats) std::cerr << stats_json("bitcrc_decode") << "\n";
+    return status;
+}
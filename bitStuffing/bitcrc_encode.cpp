@@ -1,97 +1,224 @@
 #include <iostream>
+#include <memory>
+#include <string>
 #include <vector>
-#include <fstream>
 #include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+#include "bitbuffer.h"
+#include "bitio.h"
+#include "container.h"
+#include "encoder.h"
+#include "parallel_encoder.h"
+#include "pipeline.h"
+#include "stats.h"
 
-// HDLC flag sequence: 0x7E = 01111110
-const std::vector<bool> FLAG = {0,1,1,1,1,1,1,0};
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [-s|--stream] [-b|--binary] [-j THREADS]"
+              << " [--crc NAME] [--payload BITS] [--stats] [--progress SECONDS]"
+              << " [-i INPUT] [-o OUTPUT]\n"
+              << "  Reads stream.txt and writes codedStream.txt by default, block by\n"
+              << "  block in constant memory, reading ahead and writing behind on\n"
+              << "  threads of their own while encoding.\n"
+              << "  --stream  INPUT/OUTPUT default to stdin/stdout ('-').\n"
+              << "  --binary  write the packed container format (codedStream.bin).\n"
+              << "  -j        encode on THREADS threads (0: one per core, default 1);\n"
+              << "            the output is the same as with one thread.\n"
+              << "  --crc     frame check sequence: crc16 (default), crc32, crc32c.\n"
+              << "  --payload payload bits per frame (default " << FRAME_PAYLOAD_BITS << ").\n"
+              << "  --stats   print a JSON line of timings and counts to stderr at exit.\n"
+              << "  --progress print a progress line to stderr every SECONDS.\n"
+              << "  INPUT may be '0'/'1' text or a container; it is detected.\n";
+}
 
-// CRC-16-CCITT (poly 0x1021, init 0xFFFF)
-uint16_t crc16_ccitt(const std::vector<bool>& bits) {
-    uint16_t crc = 0xFFFF;
-    for (bool bit : bits) {
-        bool msb = (crc >> 15) & 1;
-        crc <<= 1;
-        if (bit ^ msb) crc ^= 0x1021;
-    }
-    // finalize with 16 zero bits
-    for (int i = 0; i < 16; ++i) {
-        bool msb = (crc >> 15) & 1;
-        crc <<= 1;
-        if (msb) crc ^= 0x1021;
-    }
-    return crc;
+struct Options {
+    bool       binary;
+    unsigned   threads;
+    size_t     payload_bits;
+    CrcVariant crc;
+    bool       stats;
+    double     progress;    // seconds between progress lines, 0 for none
+
+    Options() : binary(false), threads(1), payload_bits(FRAME_PAYLOAD_BITS),
+                crc(CrcVariant::CRC16_CCITT), stats(false), progress(0) {}
+};
+
+static ContainerHeader coded_header(const Options& opt) {
+    ContainerHeader h;
+    h.kind = StreamKind::CODED;
+    h.crc = opt.crc;
+    h.frame_bits = static_cast<uint32_t>(opt.payload_bits);
+    h.index_stride = DEFAULT_INDEX_STRIDE;
+    return h;
 }
 
-// Insert a 0 after every sequence of five consecutive 1s
-std::vector<bool> bit_stuff(const std::vector<bool>& in) {
-    std::vector<bool> out;
-    int ones = 0;
-    for (bool b : in) {
-        out.push_back(b);
-        if (b) {
-            if (++ones == 5) {
-                out.push_back(false);
-                ones = 0;
-            }
+// FrameEncoder, or ParallelFrameEncoder when more than one thread is asked
+// for. Coded output reaches `sink` in stream order either way.
+class Encoder {
+public:
+    Encoder(const Options& opt, std::vector<uint64_t>* index, ParallelFrameEncoder::Sink sink)
+        : sink_(sink),
+          serial_(opt.payload_bits, opt.crc)
+    {
+        if (opt.threads != 1) {
+            pool_.reset(new ThreadPool(opt.threads));
+            parallel_.reset(new ParallelFrameEncoder(*pool_, sink, opt.payload_bits, opt.crc));
+            if (index) parallel_->set_index(index, DEFAULT_INDEX_STRIDE);
+        } else if (index) {
+            serial_.set_index(index, DEFAULT_INDEX_STRIDE);
+        }
+    }
+
+    void push(const BitSpan& raw) {
+        if (parallel_) {
+            parallel_->push(raw);
         } else {
-            ones = 0;
+            coded_.reserve(serial_.output_bound(raw.size()));
+            serial_.push(raw, coded_);
+            flush();
         }
     }
-    return out;
-}
 
-// Read '0'/'1' chars from a file into a bit vector
-std::vector<bool> read_bitfile(const std::string& path) {
-    std::ifstream fin(path);
-    std::vector<bool> bits;
-    char c;
-    while (fin >> c) {
-        if (c=='0' || c=='1') bits.push_back(c=='1');
+    void finish() {
+        if (parallel_) {
+            parallel_->finish();
+        } else {
+            serial_.finish(coded_);
+            flush();
+        }
     }
-    return bits;
-}
 
-// Write a bit vector as '0'/'1' chars to a file
-void write_bitfile(const std::string& path, const std::vector<bool>& bits) {
-    std::ofstream fout(path);
-    for (bool b : bits) fout << (b ? '1' : '0');
-}
+    size_t frames() const { return parallel_ ? parallel_->frames() : serial_.frames(); }
 
-int main() {
-    auto raw = read_bitfile("stream.txt");
-    if (raw.empty()) {
-        std::cerr << "Input stream is empty.\n";
-        return 1;
-    }
+private:
+    ParallelFrameEncoder::Sink sink_;
+    FrameEncoder serial_;
+    BitBuffer    coded_;
+    std::unique_ptr<ThreadPool> pool_;
+    std::unique_ptr<ParallelFrameEncoder> parallel_;
 
-    std::vector<bool> out_bits;
-    int frames = 0;
+    void flush() {
+        sink_(coded_);
+        coded_.clear();
+    }
+};
 
-    // Process in 1000-bit chunks
-    for (size_t offset = 0; offset < raw.size(); offset += 80) {
-        size_t len = std::min<size_t>(80, raw.size() - offset);
-        std::vector<bool> chunk(raw.begin() + offset, raw.begin() + offset + len);
+// Encode block by block, so memory use does not depend on the stream
+// length. This thread only encodes: the input is read ahead and the output
+// written behind by the pipeline stages. `block` is the first block, already
+// read from `reader`.
+static int encode_blocks(BitInput& reader, BitBuffer& block, int out,
+                         const std::string& in_path, const std::string& out_path,
+                         const Options& opt, std::ostream& log) {
+    WriteStage write_behind(out);
+    BitOutput writer(out, opt.binary, coded_header(opt));
+    writer.set_sink(&write_behind);
+    std::vector<uint64_t> index;
+    Encoder encoder(opt, opt.binary ? &index : nullptr, [&](const BitSpan& coded) {
+        for (size_t i = 0; i < index.size(); ++i) writer.add_index(index[i]);
+        index.clear();
+        stats_add(Stat::BITS_OUT, coded.size());
+        writer.write(coded);
+    });
+    size_t total = 0;
+    do {
+        total += block.size();
+        stats_add(Stat::BITS_IN, block.size());
+        encoder.push(block);
+        stats_set(Stat::FRAMES, encoder.frames());
+    } while (reader.read(block));
+    encoder.finish();
+    writer.finish();
 
-        // Compute CRC on raw chunk
-        uint16_t crc = crc16_ccitt(chunk);
-        // Append CRC bits MSB-first
-        for (int i = 15; i >= 0; --i) {
-            chunk.push_back((crc >> i) & 1);
-        }
+    // Every frame is two flags around its stuffed payload and CRC, so the
+    // stuffed 0s are what is left of the output
+    uint64_t frames = encoder.frames();
+    uint64_t content = total + frames * FrameCrc(opt.crc).width();
+    stats_set(Stat::FRAMES, frames);
+    stats_set(Stat::CONTENT_BITS, content);
+    stats_set(Stat::STUFFED_BITS, stats_total(Stat::BITS_OUT) - content - frames * 2 * FLAG_BITS);
 
-        // Bit-stuff the chunk+CRC
-        auto stuffed = bit_stuff(chunk);
+    if (!reader.ok()) {
+        std::cerr << "Malformed container in " << in_path << "\n";
+        return 1;
+    }
+    if (!writer.ok()) {
+        std::cerr << "Write to " << out_path << " failed.\n";
+        return 1;
+    }
+    log << "Encoded " << encoder.frames() << " frames.\n";
+    return 0;
+}
 
-        // Surround with flags
-        out_bits.insert(out_bits.end(), FLAG.begin(), FLAG.end());
-        out_bits.insert(out_bits.end(), stuffed.begin(), stuffed.end());
-        out_bits.insert(out_bits.end(), FLAG.begin(), FLAG.end());
+// The output is opened, and so truncated, only once the first block is in:
+// an empty or malformed input leaves an existing output file as it was
+static int encode_stream(const std::string& in_path, const std::string& out_path,
+                         const Options& opt, std::ostream& log) {
+    int in = open_input(in_path);
+    if (in < 0) {
+        std::cerr << "Cannot open " << in_path << "\n";
+        return 1;
+    }
+    int status = 1;
+    {
+        ReadStage read_ahead(in);
+        BitInput reader(in);
+        BitBuffer block;
+        if (reader.ok()) {
+            reader.set_source(&read_ahead);
+            while (reader.read(block) && block.empty()) {}
+        }
+        if (!reader.ok()) {
+            std::cerr << "Malformed container in " << in_path << "\n";
+        } else if (block.empty()) {
+            std::cerr << "Input stream is empty.\n";
+        } else {
+            int out = open_output(out_path);
+            if (out < 0) {
+                std::cerr << "Cannot open " << out_path << "\n";
+            } else {
+                status = encode_blocks(reader, block, out, in_path, out_path, opt, log);
+                if (out != STDOUT_FILENO) close(out);
+            }
+        }
+    }
+    if (in != STDIN_FILENO) close(in);
+    return status;
+}
 
-        ++frames;
+int main(int argc, char** argv) {
+    bool stream = false;
+    Options opt;
+    std::string in_path, out_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-s" || arg == "--stream") stream = true;
+        else if (arg == "-b" || arg == "--binary") opt.binary = true;
+        else if ((arg == "-j" || arg == "--threads") && i + 1 < argc)
+            opt.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--crc" && i + 1 < argc && parse_crc_variant(argv[i + 1], opt.crc)) ++i;
+        else if (arg == "--payload" && i + 1 < argc && std::strtoull(argv[i + 1], nullptr, 10) > 0)
+            opt.payload_bits = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--stats") opt.stats = true;
+        else if (arg == "--progress" && i + 1 < argc)
+            opt.progress = std::strtod(argv[++i], nullptr);
+        else if (arg == "-i" && i + 1 < argc) in_path = argv[++i];
+        else if (arg == "-o" && i + 1 < argc) out_path = argv[++i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
     }
+    if (in_path.empty()) in_path = stream ? "-" : "stream.txt";
+    if (out_path.empty())
+        out_path = stream ? "-" : opt.binary ? "codedStream.bin" : "codedStream.txt";
 
-    write_bitfile("codedStream.txt", out_bits);
-    std::cout << "Encoded " << frames << " frames.\n";
-    return 0;
+    std::ostream& log = stream || out_path == "-" ? std::cerr : std::cout;
+    int status;
+    {
+        StatsProgress progress("bitcrc_encode", opt.progress);
+        status = encode_stream(in_path, out_path, opt, log);
+    }
+    if (opt.stats) std::cerr << stats_json("bitcrc_encode") << "\n";
+    return status;
 }
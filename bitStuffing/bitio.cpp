@@ -0,0 +1,314 @@
+// bitio.cpp
+#include "bitio.h"
+#include "stats.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITIO_X86 1
+#endif
+
+namespace {
+
+const uint64_t ONES8  = 0x0101010101010101ULL;
+const uint64_t ZEROS8 = 0x3030303030303030ULL;    // "00000000"
+
+// ascii8[b] holds the 8 chars of byte b, first char in the lowest address
+struct AsciiTable {
+    uint64_t ascii8[256];
+    bool     avx2;
+
+    AsciiTable() {
+        for (unsigned b = 0; b < 256; ++b) {
+            char c[8];
+            for (int i = 0; i < 8; ++i) c[i] = ((b >> (7 - i)) & 1) ? '1' : '0';
+            std::memcpy(&ascii8[b], c, 8);
+        }
+#ifdef BITIO_X86
+        avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+#else
+        avx2 = false;
+#endif
+    }
+};
+
+const AsciiTable table;
+
+// Accumulates single bits and hands them to the buffer 64 at a time
+struct BitSink {
+    BitBuffer& out;
+    uint64_t   word;
+    unsigned   have;
+
+    explicit BitSink(BitBuffer& o) : out(o), word(0), have(0) {}
+    ~BitSink() { out.append(word, have); }
+
+    void put(uint64_t v, unsigned n) {
+        if (have + n > 64) {
+            out.append(word, have);
+            word = 0;
+            have = 0;
+        }
+        word = (n == 64) ? v : ((word << n) | v);
+        have += n;
+    }
+};
+
+// Eight chars at a time when all of them are '0'/'1', one at a time otherwise
+void pack_tail(const char* p, size_t n, BitSink& sink) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t u;
+        std::memcpy(&u, p + i, 8);
+        if ((u & ~ONES8) == ZEROS8) {
+            // gather the low bit of every byte, first byte to the top
+            sink.put(((u & ONES8) * 0x8040201008040201ULL) >> 56, 8);
+            continue;
+        }
+        for (size_t j = i; j < i + 8; ++j)
+            if (p[j] == '0' || p[j] == '1') sink.put(p[j] == '1', 1);
+    }
+    for (; i < n; ++i)
+        if (p[i] == '0' || p[i] == '1') sink.put(p[i] == '1', 1);
+}
+
+#ifdef BITIO_X86
+
+// 32 chars -> 32-bit masks with the first char in bit 31
+__attribute__((target("avx2,bmi2")))
+inline void classify32(const char* p, uint32_t& ones, uint32_t& valid) {
+    const __m256i rev = _mm256_setr_epi8(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0,
+                                         15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0);
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    x = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(x, rev), 0x4E);
+    __m256i one  = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('1'));
+    __m256i zero = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('0'));
+    ones  = static_cast<uint32_t>(_mm256_movemask_epi8(one));
+    valid = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(one, zero)));
+}
+
+__attribute__((target("avx2,bmi2")))
+void pack_avx2(const char* p, size_t n, BitBuffer& out) {
+    BitSink sink(out);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        uint32_t o0, v0, o1, v1;
+        classify32(p + i, o0, v0);
+        classify32(p + i + 32, o1, v1);
+        uint64_t ones  = (uint64_t(o0) << 32) | o1;
+        uint64_t valid = (uint64_t(v0) << 32) | v1;
+        if (~valid == 0) {
+            sink.put(ones, 64);
+        } else {
+            // keep only the '0'/'1' positions, still first char on top
+            unsigned n_valid = static_cast<unsigned>(__builtin_popcountll(valid));
+            if (n_valid) sink.put(_pext_u64(ones, valid), n_valid);
+        }
+    }
+    pack_tail(p + i, n - i, sink);
+}
+
+// 32 bits (first in bit 31) -> 32 chars
+__attribute__((target("avx2,bmi2")))
+inline void expand32(uint32_t v, char* dst) {
+    const __m256i pick = _mm256_setr_epi8(3,3,3,3,3,3,3,3,2,2,2,2,2,2,2,2,
+                                          1,1,1,1,1,1,1,1,0,0,0,0,0,0,0,0);
+    const __m256i bit  = _mm256_set1_epi64x(static_cast<int64_t>(0x0102040810204080ULL));
+    __m256i x = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(v)), pick);
+    __m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(x, bit), bit);
+    __m256i chars = _mm256_sub_epi8(_mm256_set1_epi8('0'), set);   // '0' - (-1) == '1'
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), chars);
+}
+
+__attribute__((target("avx2,bmi2")))
+void unpack_avx2(const BitSpan& bits, char* dst) {
+    size_t full = bits.size() / 64;
+    for (size_t k = 0; k < full; ++k) {
+        uint64_t w = bits.word(k);
+        expand32(static_cast<uint32_t>(w >> 32), dst);
+        expand32(static_cast<uint32_t>(w), dst + 32);
+        dst += 64;
+    }
+    unsigned rest = bits.size() & 63;
+    if (rest) unpack_ascii_scalar(bits.subspan(full * 64), dst);
+}
+
+#endif
+
+} // namespace
+
+void pack_ascii_scalar(const char* text, size_t len, BitBuffer& out) {
+    BitSink sink(out);
+    pack_tail(text, len, sink);
+}
+
+void unpack_ascii_scalar(const BitSpan& bits, char* dst) {
+    size_t full = bits.size() / 64;
+    for (size_t k = 0; k < full; ++k) {
+        uint64_t w = bits.word(k);
+        for (int b = 0; b < 8; ++b)
+            std::memcpy(dst + 8 * b, &table.ascii8[(w >> (56 - 8 * b)) & 0xFF], 8);
+        dst += 64;
+    }
+    unsigned rest = bits.size() & 63;
+    if (rest) {
+        uint64_t w = bits.word(full);
+        for (unsigned i = 0; i < rest; ++i) dst[i] = ((w >> (63 - i)) & 1) ? '1' : '0';
+    }
+}
+
+void pack_ascii(const char* text, size_t len, BitBuffer& out) {
+#ifdef BITIO_X86
+    if (table.avx2) return pack_avx2(text, len, out);
+#endif
+    pack_ascii_scalar(text, len, out);
+}
+
+void unpack_ascii(const BitSpan& bits, char* dst) {
+#ifdef BITIO_X86
+    if (table.avx2) return unpack_avx2(bits, dst);
+#endif
+    unpack_ascii_scalar(bits, dst);
+}
+
+const char* bitio_engine_name() {
+    return table.avx2 ? "avx2" : "scalar";
+}
+
+int open_input(const std::string& path) {
+    if (path == "-") return STDIN_FILENO;
+    return ::open(path.c_str(), O_RDONLY);
+}
+
+int open_output(const std::string& path) {
+    if (path == "-") return STDOUT_FILENO;
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+BitReader::BitReader(int fd, size_t block_bytes)
+    : fd_(fd),
+      buf_(block_bytes),
+      source_(nullptr)
+{
+}
+
+BitReader::BitReader(int fd, const std::string& prefix, size_t block_bytes)
+    : fd_(fd),
+      buf_(block_bytes),
+      prefix_(prefix),
+      source_(nullptr)
+{
+}
+
+bool BitReader::read(BitBuffer& bits) {
+    bits.clear();
+    if (!prefix_.empty()) {
+        pack_ascii(prefix_.data(), prefix_.size(), bits);
+        prefix_.clear();
+        return true;
+    }
+    if (source_) {
+        size_t len;
+        if (!source_->get(buf_, len)) return false;
+        pack_ascii(buf_.data(), len, bits);
+        return true;
+    }
+    ssize_t n;
+    do {
+        n = ::read(fd_, buf_.data(), buf_.size());
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return false;
+    stats_add(Stat::BYTES_IN, static_cast<size_t>(n));
+    pack_ascii(buf_.data(), static_cast<size_t>(n), bits);
+    return true;
+}
+
+BitWriter::BitWriter(int fd, size_t block_bytes)
+    : fd_(fd),
+      ok_(fd >= 0),
+      buf_(block_bytes),
+      used_(0),
+      sink_(nullptr)
+{
+}
+
+BitWriter::~BitWriter() {
+    flush();
+}
+
+// Expand into the buffer a buffer-full at a time
+void BitWriter::write(const BitSpan& bits) {
+    size_t pos = 0;
+    while (pos < bits.size()) {
+        if (used_ == buf_.size()) put_buffer();
+        size_t n = std::min(bits.size() - pos, buf_.size() - used_);
+        unpack_ascii(bits.subspan(pos, n), &buf_[used_]);
+        used_ += n;
+        pos += n;
+    }
+}
+
+void BitWriter::flush() {
+    put_buffer();
+    if (sink_ && !sink_->flush()) ok_ = false;
+}
+
+void BitWriter::put_buffer() {
+    if (sink_) {
+        if (ok_ && used_ && !sink_->put(buf_, used_)) ok_ = false;
+        used_ = 0;
+        return;
+    }
+    size_t done = 0;
+    while (ok_ && done < used_) {
+        ssize_t n = ::write(fd_, buf_.data() + done, used_ - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) ok_ = false;
+        else done += static_cast<size_t>(n);
+    }
+    used_ = 0;
+}
+
+BitBuffer read_bitfile(const std::string& path) {
+    BitBuffer bits;
+    int fd = open_input(path);
+    if (fd < 0) return bits;
+
+    struct stat st;
+    if (fd != STDIN_FILENO && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t len = static_cast<size_t>(st.st_size);
+        void* map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, len, MADV_SEQUENTIAL);
+            bits.reserve(len);
+            pack_ascii(static_cast<const char*>(map), len, bits);
+            stats_add(Stat::BYTES_IN, len);
+            munmap(map, len);
+            ::close(fd);
+            return bits;
+        }
+    }
+
+    // Pipes, terminals and anything mmap refuses go through read()
+    BitReader reader(fd);
+    BitBuffer block;
+    while (reader.read(block)) bits.append(block);
+    if (fd != STDIN_FILENO) ::close(fd);
+    return bits;
+}
+
+void write_bitfile(const std::string& path, const BitSpan& bits) {
+    int fd = open_output(path);
+    if (fd < 0) return;
+    {
+        BitWriter writer(fd);
+        writer.write(bits);
+    }
+    if (fd != STDOUT_FILENO) ::close(fd);
+}
@@ -0,0 +1,112 @@
+// bitio.h
+#ifndef BITIO_H
+#define BITIO_H
+
+#include <string>
+#include <vector>
+#include "bitbuffer.h"
+
+// Bytes of text handled per read/write call in streaming mode
+const size_t BLOCK_BYTES = 1 << 20;
+
+// Read '0'/'1' chars from a file into a bit buffer; anything else is skipped.
+// Regular files are memory-mapped rather than read.
+BitBuffer read_bitfile(const std::string& path);
+
+// Write bits as '0'/'1' chars to a file
+void write_bitfile(const std::string& path, const BitSpan& bits);
+
+// Append the bits of '0'/'1' text to `out`, skipping any other character.
+// Uses AVX2 compares + movemask (and BMI2 pext around whitespace) when the
+// CPU has them.
+void pack_ascii(const char* text, size_t len, BitBuffer& out);
+
+// Write bits.size() '0'/'1' chars to `dst`
+void unpack_ascii(const BitSpan& bits, char* dst);
+
+// Portable versions, exposed so the vector paths can be checked against them
+void pack_ascii_scalar(const char* text, size_t len, BitBuffer& out);
+void unpack_ascii_scalar(const BitSpan& bits, char* dst);
+
+// Name of the packing engine selected for this CPU
+const char* bitio_engine_name();
+
+// Open a file for reading or writing; "-" means stdin / stdout.
+// Returns -1 on failure.
+int open_input(const std::string& path);
+int open_output(const std::string& path);
+
+// Where the format readers get their bytes once the header is parsed,
+// instead of read() on the descriptor: pipeline.h reads ahead on a thread
+// of its own. Blocks are swapped, not copied.
+class ByteSource {
+public:
+    virtual ~ByteSource() {}
+
+    // Replace `block` with the next block of input, `len` bytes of it
+    // filled; the old block may be reused. False at the end of input.
+    virtual bool get(std::vector<char>& block, size_t& len) = 0;
+};
+
+// Where the format writers send full buffers, instead of write()
+class ByteSink {
+public:
+    virtual ~ByteSink() {}
+
+    // Take the first `len` bytes of `block` for writing and replace it with
+    // an empty buffer of the same size. False once a write has failed.
+    virtual bool put(std::vector<char>& block, size_t len) = 0;
+
+    // Wait until everything put so far is written; false if any write failed
+    virtual bool flush() = 0;
+};
+
+// Reads the '0'/'1' text format from a file descriptor one block at a time
+class BitReader {
+public:
+    explicit BitReader(int fd, size_t block_bytes = BLOCK_BYTES);
+
+    // Same, for input whose first bytes were already consumed (e.g. while
+    // sniffing the format); they are handed out before reading `fd`
+    BitReader(int fd, const std::string& prefix, size_t block_bytes = BLOCK_BYTES);
+
+    // Replace `bits` with the bits of the next block (possibly none, if the
+    // block was all whitespace). Returns false at end of input.
+    bool read(BitBuffer& bits);
+
+    // Take the bytes after the prefix from `source` rather than `fd`
+    void set_source(ByteSource* source) { source_ = source; }
+
+private:
+    int fd_;
+    std::vector<char> buf_;
+    std::string prefix_;
+    ByteSource* source_;
+};
+
+// Writes bits as '0'/'1' text through a fixed-size buffer
+class BitWriter {
+public:
+    explicit BitWriter(int fd, size_t block_bytes = BLOCK_BYTES);
+    ~BitWriter();
+
+    void write(const BitSpan& bits);
+    void flush();
+
+    // False once a write to the descriptor has failed
+    bool ok() const { return ok_; }
+
+    // Hand full buffers to `sink` rather than writing `fd`
+    void set_sink(ByteSink* sink) { sink_ = sink; }
+
+private:
+    int fd_;
+    bool ok_;
+    std::vector<char> buf_;
+    size_t used_;
+    ByteSink* sink_;
+
+    void put_buffer();
+};
+
+#endif // BITIO_H
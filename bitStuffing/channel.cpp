@@ -0,0 +1,78 @@
+// channel.cpp
+#include "channel.h"
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// a + b, stuck at NEVER instead of wrapping
+uint64_t later(uint64_t a, uint64_t b) {
+    return b > NEVER - a ? NEVER : a + b;
+}
+
+} // namespace
+
+uint64_t channel_seed(uint64_t seed, uint64_t index) {
+    return splitmix64(seed ^ splitmix64(index));
+}
+
+Channel::Channel(const ChannelParams& params, uint64_t seed)
+    : params_(params),
+      rng_(splitmix64(seed) | 1),     // xorshift needs a non-zero state
+      pos_(0),
+      bad_(false),
+      errors_(0)
+{
+    state_end_ = params_.burst ? later(1, gap(params_.to_bad)) : NEVER;
+    next_error_ = gap(params_.ber);
+}
+
+void Channel::apply(BitBuffer& bits) {
+    uint64_t end = pos_ + bits.size();
+    for (;;) {
+        if (next_error_ >= state_end_) {
+            if (state_end_ >= end) break;
+            change_state();
+            continue;
+        }
+        if (next_error_ >= end) break;
+        bits.flip(static_cast<size_t>(next_error_ - pos_));
+        ++errors_;
+        next_error_ = later(next_error_ + 1, gap(bad_ ? params_.bad_ber : params_.ber));
+    }
+    pos_ = end;
+}
+
+// Both waits are memoryless, so the error gap is simply drawn again from
+// the first bit of the new state
+void Channel::change_state() {
+    uint64_t at = state_end_;
+    bad_ = !bad_;
+    state_end_ = later(at + 1, gap(bad_ ? params_.to_good : params_.to_bad));
+    next_error_ = later(at, gap(bad_ ? params_.bad_ber : params_.ber));
+}
+
+// xorshift64*, top 53 bits
+double Channel::uniform() {
+    rng_ ^= rng_ >> 12;
+    rng_ ^= rng_ << 25;
+    rng_ ^= rng_ >> 27;
+    return static_cast<double>(((rng_ * 0x2545F4914F6CDD1DULL) >> 11) + 1) / 9007199254740992.0;
+}
+
+// Inversion of the geometric distribution: floor(ln U / ln(1 - p))
+uint64_t Channel::gap(double p) {
+    if (!(p > 0)) return NEVER;
+    if (p >= 1) return 0;
+    double g = std::floor(std::log(uniform()) / std::log1p(-p));
+    return g >= 1.8e19 ? NEVER : static_cast<uint64_t>(g);
+}
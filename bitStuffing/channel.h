@@ -0,0 +1,55 @@
+// channel.h
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <cstdint>
+#include "bitbuffer.h"
+
+// Error model of a noisy link. With `burst` off every bit is flipped
+// independently with probability `ber`. With it on, the link is a
+// Gilbert-Elliott chain: a good state with error rate `ber` and a bad one
+// with `bad_ber`, left after each bit with probability `to_bad` and
+// `to_good` respectively.
+struct ChannelParams {
+    double ber;
+    bool   burst;
+    double to_bad;
+    double to_good;
+    double bad_ber;
+
+    ChannelParams() : ber(0), burst(false), to_bad(0), to_good(0), bad_ber(0.5) {}
+};
+
+// Flips the bits of a stream that the model hits. The distance to the next
+// error (and to the next state change) is drawn from a geometric
+// distribution, so the work is per error rather than per bit and clean
+// stretches cost nothing. Equal seeds give equal errors, however the
+// stream is cut into pieces.
+class Channel {
+public:
+    Channel(const ChannelParams& params, uint64_t seed);
+
+    // The next piece of the stream
+    void apply(BitBuffer& bits);
+
+    uint64_t bits() const { return pos_; }
+    uint64_t errors() const { return errors_; }
+
+private:
+    ChannelParams params_;
+    uint64_t rng_;
+    uint64_t pos_;          // stream bits seen so far
+    uint64_t next_error_;   // stream position of the next flip
+    uint64_t state_end_;    // first bit after the current state's run
+    bool     bad_;
+    uint64_t errors_;
+
+    double   uniform();                 // in (0, 1]
+    uint64_t gap(double p);             // failures before a success of probability p
+    void     change_state();
+};
+
+// Seed for the `index`th of several independent runs derived from one seed
+uint64_t channel_seed(uint64_t seed, uint64_t index);
+
+#endif // CHANNEL_H
@@ -0,0 +1,469 @@
+// container.cpp
+#include "container.h"
+#include "stats.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char MAGIC[4]   = {'H', 'D', 'L', 'B'};
+const char END_TAG[4] = {'H', 'D', 'L', 'E'};
+
+// Offset of the `bits` field in the header, patched after writing
+const size_t BITS_FIELD = 8;
+
+// Bytes a reader of unknown length keeps back: the trailer, and the last
+// data byte whose padding only the trailer can tell apart
+const size_t HOLD_BYTES = TRAILER_BYTES + 1;
+
+void put_le(char* p, uint64_t v, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; ++i) p[i] = static_cast<char>(v >> (8 * i));
+}
+
+uint64_t get_le(const char* p, unsigned bytes) {
+    uint64_t v = 0;
+    for (unsigned i = 0; i < bytes; ++i)
+        v |= uint64_t(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+uint64_t get_be64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+uint64_t data_bytes(uint64_t bits) { return (bits + 7) / 8; }
+
+// Append big-endian bytes to `bits`, 64 at a time where possible
+void append_bytes(const char* p, size_t n, BitBuffer& bits) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) bits.append(get_be64(p + i), 64);
+    for (; i < n; ++i) bits.append(static_cast<unsigned char>(p[i]), 8);
+}
+
+size_t read_full(int fd, char* p, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = ::read(fd, p + done, n - done);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        done += static_cast<size_t>(r);
+    }
+    return done;
+}
+
+bool pread_full(int fd, char* p, size_t n, off_t at) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = ::pread(fd, p + done, n - done, at + static_cast<off_t>(done));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        done += static_cast<size_t>(r);
+    }
+    return true;
+}
+
+// Start of the container in `fd`, given that `consumed` bytes of it have
+// been read; -1 if the descriptor cannot seek
+off_t container_base(int fd, size_t consumed) {
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    return pos < 0 ? -1 : pos - static_cast<off_t>(consumed);
+}
+
+// Locate the trailer through the file size and return the stream length
+// and index entry count recorded in it
+bool read_trailer(int fd, off_t base, uint64_t& bits, uint64_t& entries) {
+    struct stat st;
+    if (base < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    off_t end = st.st_size;
+    if (end - base < static_cast<off_t>(HEADER_BYTES + TRAILER_BYTES)) return false;
+    char t[TRAILER_BYTES];
+    if (!pread_full(fd, t, TRAILER_BYTES, end - static_cast<off_t>(TRAILER_BYTES)))
+        return false;
+    stats_add(Stat::BYTES_IN, TRAILER_BYTES);
+    if (std::memcmp(t + 16, END_TAG, 4) != 0) return false;
+    bits    = get_le(t, 8);
+    entries = get_le(t + 8, 8);
+    uint64_t expect = HEADER_BYTES + data_bytes(bits) + 8 * entries + TRAILER_BYTES;
+    return static_cast<uint64_t>(end - base) == expect;
+}
+
+} // namespace
+
+bool is_container(const char* bytes, size_t len) {
+    return len >= 4 && std::memcmp(bytes, MAGIC, 4) == 0;
+}
+
+bool parse_header(const char* bytes, ContainerHeader& header) {
+    if (!is_container(bytes, HEADER_BYTES)) return false;
+    if (get_le(bytes + 4, 2) != CONTAINER_VERSION) return false;
+    unsigned kind = static_cast<unsigned char>(bytes[6]);
+    if (kind > static_cast<unsigned>(StreamKind::CODED)) return false;
+    header.kind         = static_cast<StreamKind>(kind);
+    header.crc          = static_cast<CrcVariant>(bytes[7]);
+    header.bits         = get_le(bytes + BITS_FIELD, 8);
+    header.frame_bits   = static_cast<uint32_t>(get_le(bytes + 16, 4));
+    header.index_stride = static_cast<uint32_t>(get_le(bytes + 20, 4));
+    return true;
+}
+
+// ---- ContainerWriter ----
+
+ContainerWriter::ContainerWriter(int fd, const ContainerHeader& header)
+    : fd_(fd),
+      ok_(fd >= 0),
+      finished_(false),
+      header_(header),
+      base_(container_base(fd, 0)),
+      bits_(0),
+      carry_(0),
+      ncarry_(0),
+      buf_(BLOCK_BYTES),
+      used_(0),
+      sink_(nullptr)
+{
+    char h[HEADER_BYTES] = {};
+    std::memcpy(h, MAGIC, 4);
+    put_le(h + 4, CONTAINER_VERSION, 2);
+    h[6] = static_cast<char>(header_.kind);
+    h[7] = static_cast<char>(header_.crc);
+    put_le(h + BITS_FIELD, UNKNOWN_BITS, 8);
+    put_le(h + 16, header_.frame_bits, 4);
+    put_le(h + 20, header_.index_stride, 4);
+    put(h, sizeof h);
+}
+
+ContainerWriter::~ContainerWriter() {
+    finish();
+}
+
+void ContainerWriter::write(const BitSpan& bits) {
+    size_t n = bits.size();
+    size_t full = n / 64;
+    for (size_t k = 0; k < full; ++k) {
+        uint64_t w = bits.word(k);
+        if (ncarry_ == 0) {
+            put_word(w);
+        } else {
+            put_word(carry_ | (w >> ncarry_));
+            carry_ = w << (64 - ncarry_);
+        }
+    }
+    unsigned rest = n & 63;
+    if (rest) {
+        uint64_t w = bits.word(full);
+        carry_ |= w >> ncarry_;
+        if (ncarry_ + rest >= 64) {
+            put_word(carry_);
+            carry_ = ncarry_ ? w << (64 - ncarry_) : 0;
+            ncarry_ = ncarry_ + rest - 64;
+        } else {
+            ncarry_ += rest;
+        }
+    }
+    bits_ += n;
+}
+
+void ContainerWriter::put_word(uint64_t w) {
+    char b[8];
+    for (unsigned i = 0; i < 8; ++i) b[i] = static_cast<char>(w >> (56 - 8 * i));
+    put(b, 8);
+}
+
+void ContainerWriter::put(const void* p, size_t n) {
+    const char* src = static_cast<const char*>(p);
+    while (n) {
+        if (used_ == buf_.size()) flush();
+        size_t k = std::min(n, buf_.size() - used_);
+        std::memcpy(&buf_[used_], src, k);
+        used_ += k;
+        src += k;
+        n -= k;
+    }
+}
+
+void ContainerWriter::flush() {
+    if (sink_) {
+        if (ok_ && used_ && !sink_->put(buf_, used_)) ok_ = false;
+        used_ = 0;
+        return;
+    }
+    size_t done = 0;
+    while (ok_ && done < used_) {
+        ssize_t n = ::write(fd_, buf_.data() + done, used_ - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) ok_ = false;
+        else done += static_cast<size_t>(n);
+    }
+    used_ = 0;
+}
+
+void ContainerWriter::finish() {
+    if (finished_) return;
+    finished_ = true;
+
+    for (unsigned i = 0; i < (ncarry_ + 7) / 8; ++i) {
+        char b = static_cast<char>(carry_ >> (56 - 8 * i));
+        put(&b, 1);
+    }
+    if (base_ < 0) index_.clear();
+    for (size_t i = 0; i < index_.size(); ++i) {
+        char e[8];
+        put_le(e, index_[i], 8);
+        put(e, 8);
+    }
+    char t[TRAILER_BYTES] = {};
+    put_le(t, bits_, 8);
+    put_le(t + 8, index_.size(), 8);
+    std::memcpy(t + 16, END_TAG, 4);
+    put(t, sizeof t);
+    flush();
+    if (sink_ && !sink_->flush()) ok_ = false;
+
+    // Fill in the length up front where the output allows it; on a pipe the
+    // trailer is the only record
+    if (ok_ && base_ >= 0) {
+        char b[8];
+        put_le(b, bits_, 8);
+        if (::pwrite(fd_, b, 8, base_ + static_cast<off_t>(BITS_FIELD)) != 8) ok_ = false;
+    }
+}
+
+// ---- ContainerReader ----
+
+ContainerReader::ContainerReader(int fd, const ContainerHeader& header, size_t block_bytes)
+    : fd_(fd),
+      ok_(true),
+      header_(header),
+      base_(container_base(fd, HEADER_BYTES)),
+      buf_(block_bytes + HOLD_BYTES),
+      until_eof_(false),
+      held_(0),
+      bits_read_(0),
+      source_(nullptr)
+{
+    if (header_.bits == UNKNOWN_BITS) {
+        uint64_t entries;
+        until_eof_ = !read_trailer(fd_, base_, header_.bits, entries);
+        if (until_eof_) header_.bits = UNKNOWN_BITS;
+    }
+    bits_left_  = until_eof_ ? 0 : header_.bits;
+    bytes_left_ = data_bytes(bits_left_);
+}
+
+bool ContainerReader::read(BitBuffer& bits) {
+    bits.clear();
+    if (until_eof_) return read_until_eof(bits);
+    if (bytes_left_ == 0) return false;
+    size_t want = static_cast<size_t>(std::min<uint64_t>(buf_.size(), bytes_left_));
+    size_t n = std::min<uint64_t>(read_some(want), bytes_left_);
+    if (n == 0 || (!source_ && n < want)) {
+        bytes_left_ = 0;        // truncated file
+        ok_ = false;
+        return false;
+    }
+    append_bytes(buf_.data(), n, bits);
+    bits.truncate(static_cast<size_t>(std::min<uint64_t>(bits.size(), bits_left_)));
+    bits_left_  -= bits.size();
+    bytes_left_ -= n;
+    return true;
+}
+
+// Data into buf_: `want` bytes from the descriptor, short only at its end,
+// or the source's next block of whatever size (the source counts its own)
+size_t ContainerReader::read_some(size_t want) {
+    size_t n;
+    if (!source_) {
+        n = read_full(fd_, buf_.data(), want);
+        stats_add(Stat::BYTES_IN, n);
+        return n;
+    }
+    return source_->get(buf_, n) ? n : 0;
+}
+
+// Sequential read of a container whose length is only in its trailer
+bool ContainerReader::read_until_eof(BitBuffer& bits) {
+    if (held_ > HOLD_BYTES) return false;       // end already reached
+    size_t n = 0;
+    if (!source_) {
+        n = read_full(fd_, buf_.data() + held_, buf_.size() - HOLD_BYTES);
+        stats_add(Stat::BYTES_IN, n);
+    } else if (source_->get(block_, n)) {
+        // Behind the bytes held back, so this one copies
+        if (buf_.size() < held_ + n) buf_.resize(held_ + n);
+        std::memcpy(buf_.data() + held_, block_.data(), n);
+    }
+    size_t have = held_ + n;
+    if (n > 0) {
+        size_t emit = have > HOLD_BYTES ? have - HOLD_BYTES : 0;
+        append_bytes(buf_.data(), emit, bits);
+        bits_read_ += bits.size();
+        std::memmove(buf_.data(), buf_.data() + emit, have - emit);
+        held_ = have - emit;
+        return true;
+    }
+
+    // End of input: what is held back must be the last byte and the trailer
+    const char* t = buf_.data() + held_ - TRAILER_BYTES;
+    held_ = HOLD_BYTES + 1;
+    if (have < TRAILER_BYTES || std::memcmp(t + 16, END_TAG, 4) != 0
+        || get_le(t + 8, 8) != 0) {
+        ok_ = false;
+        return false;
+    }
+    uint64_t total = get_le(t, 8);
+    uint64_t rest  = total - bits_read_;
+    if (total < bits_read_ || rest > 8 || (have - TRAILER_BYTES) != (rest ? 1u : 0u)) {
+        ok_ = false;
+        return false;
+    }
+    header_.bits = total;
+    if (rest) bits.append(static_cast<unsigned char>(buf_[0]) >> (8 - rest), static_cast<unsigned>(rest));
+    return true;
+}
+
+bool ContainerReader::read_range(uint64_t pos, uint64_t len, BitBuffer& bits) const {
+    if (len == 0) return true;
+    if (base_ < 0 || pos + len > header_.bits) return false;
+    uint64_t first = pos / 8, last = (pos + len + 7) / 8;
+    std::vector<char> raw(static_cast<size_t>(last - first));
+    if (!pread_full(fd_, raw.data(), raw.size(), base_ + static_cast<off_t>(HEADER_BYTES + first)))
+        return false;
+    stats_add(Stat::BYTES_IN, raw.size());
+    BitBuffer tmp;
+    append_bytes(raw.data(), raw.size(), tmp);
+    bits.append(tmp.span(static_cast<size_t>(pos % 8), static_cast<size_t>(len)));
+    return true;
+}
+
+bool ContainerReader::read_index(std::vector<uint64_t>& index) const {
+    uint64_t bits, entries;
+    if (!read_trailer(fd_, base_, bits, entries) || bits != header_.bits) return false;
+    std::vector<char> raw(static_cast<size_t>(8 * entries));
+    off_t at = base_ + static_cast<off_t>(HEADER_BYTES + data_bytes(bits));
+    if (!raw.empty() && !pread_full(fd_, raw.data(), raw.size(), at)) return false;
+    stats_add(Stat::BYTES_IN, raw.size());
+    index.resize(static_cast<size_t>(entries));
+    for (size_t i = 0; i < index.size(); ++i) index[i] = get_le(&raw[8 * i], 8);
+    return true;
+}
+
+// ---- BitInput / BitOutput ----
+
+BitInput::BitInput(int fd)
+    : ok_(fd >= 0)
+{
+    if (!ok_) return;
+    char head[HEADER_BYTES];
+    size_t n = read_full(fd, head, sizeof head);
+    stats_add(Stat::BYTES_IN, n);
+    if (is_container(head, n)) {
+        ok_ = n == HEADER_BYTES && parse_header(head, header_);
+        if (ok_) bin_.reset(new ContainerReader(fd, header_));
+    } else {
+        text_.reset(new BitReader(fd, std::string(head, n)));
+    }
+}
+
+bool BitInput::ok() const {
+    return ok_ && (!bin_ || bin_->ok());
+}
+
+const ContainerHeader& BitInput::header() const {
+    return bin_ ? bin_->header() : header_;
+}
+
+void BitInput::set_source(ByteSource* source) {
+    if (bin_) bin_->set_source(source);
+    if (text_) text_->set_source(source);
+}
+
+bool BitInput::read(BitBuffer& bits) {
+    if (bin_) return bin_->read(bits);
+    if (text_) return text_->read(bits);
+    bits.clear();
+    return false;
+}
+
+BitOutput::BitOutput(int fd, bool binary, const ContainerHeader& header) {
+    if (binary) bin_.reset(new ContainerWriter(fd, header));
+    else text_.reset(new BitWriter(fd));
+}
+
+void BitOutput::write(const BitSpan& bits) {
+    if (bin_) bin_->write(bits);
+    else text_->write(bits);
+}
+
+void BitOutput::add_index(uint64_t bit_offset) {
+    if (bin_) bin_->add_index(bit_offset);
+}
+
+void BitOutput::finish() {
+    if (bin_) bin_->finish();
+    else text_->flush();
+}
+
+void BitOutput::set_sink(ByteSink* sink) {
+    if (bin_) bin_->set_sink(sink);
+    else text_->set_sink(sink);
+}
+
+bool BitOutput::ok() const {
+    return bin_ ? bin_->ok() : text_->ok();
+}
+
+BitBuffer load_bits(const std::string& path, ContainerHeader* header, bool* malformed) {
+    if (header) *header = ContainerHeader();
+    if (malformed) *malformed = false;
+    int fd = open_input(path);
+    if (fd < 0) return BitBuffer();
+
+    // Text files keep the memory-mapped path
+    struct stat st;
+    char magic[4];
+    if (fd != STDIN_FILENO && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && !(pread_full(fd, magic, 4, 0) && is_container(magic, 4))) {
+        ::close(fd);
+        return read_bitfile(path);
+    }
+
+    BitBuffer bits, block;
+    BitInput input(fd);
+    if (input.ok()) {
+        if (input.binary() && input.header().bits != UNKNOWN_BITS)
+            bits.reserve(static_cast<size_t>(input.header().bits));
+        while (input.read(block)) bits.append(block);
+        if (header) *header = input.header();
+    }
+    if (!input.ok()) {
+        bits.clear();
+        if (malformed) *malformed = true;
+    }
+    if (fd != STDIN_FILENO) ::close(fd);
+    return bits;
+}
+
+bool save_bits(const std::string& path, const BitSpan& bits, bool binary,
+               const ContainerHeader& header, const std::vector<uint64_t>& index) {
+    int fd = open_output(path);
+    if (fd < 0) return false;
+    bool ok;
+    {
+        BitOutput out(fd, binary, header);
+        for (size_t i = 0; i < index.size(); ++i) out.add_index(index[i]);
+        out.write(bits);
+        out.finish();
+        ok = out.ok();
+    }
+    if (fd != STDOUT_FILENO) ::close(fd);
+    return ok;
+}
@@ -0,0 +1,194 @@
+// container.h
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bitbuffer.h"
+#include "bitio.h"
+#include "crc.h"
+
+// Packed binary container for raw and coded streams: one bit per bit on disk
+// instead of one '0'/'1' byte. Layout, integers little-endian:
+//
+//   header   32 bytes   "HDLB", version u16, kind u8, crc u8, bits u64,
+//                       frame_bits u32, index_stride u32, reserved u64
+//   data     ceil(bits / 8) bytes, stream bits MSB-first, zero padded
+//   index    n x u64    bit offset in data of frame 0, stride, 2*stride, ...
+//   trailer  24 bytes   bits u64, n u64, "HDLE", reserved u32
+//
+// The header's `bits` is patched once writing is done if the output is
+// seekable. Written to a pipe it stays UNKNOWN_BITS, the index is left out
+// (nothing could seek to use it) and readers take the length from the
+// trailer.
+
+enum class StreamKind : uint8_t {
+    RAW   = 0,      // payload bits, as in stream.txt
+    CODED = 1       // framed, stuffed bits, as in codedStream.txt
+};
+
+const uint16_t CONTAINER_VERSION    = 1;
+const uint64_t UNKNOWN_BITS         = ~uint64_t(0);
+const size_t   HEADER_BYTES         = 32;
+const size_t   TRAILER_BYTES        = 24;
+const uint32_t DEFAULT_INDEX_STRIDE = 1024;
+
+struct ContainerHeader {
+    StreamKind kind;
+    CrcVariant crc;
+    uint64_t   bits;
+    uint32_t   frame_bits;      // payload bits per frame, 0 if unknown
+    uint32_t   index_stride;    // frames per index entry, 0 if no index
+
+    ContainerHeader()
+        : kind(StreamKind::RAW), crc(CrcVariant::CRC16_CCITT), bits(UNKNOWN_BITS),
+          frame_bits(0), index_stride(0) {}
+};
+
+// True when `bytes` starts with the container magic
+bool is_container(const char* bytes, size_t len);
+
+// Parse HEADER_BYTES bytes; false if they are not a supported header
+bool parse_header(const char* bytes, ContainerHeader& header);
+
+// Writes a container to a file descriptor, data first, index at the end
+class ContainerWriter {
+public:
+    ContainerWriter(int fd, const ContainerHeader& header);
+    ~ContainerWriter();
+
+    void write(const BitSpan& bits);
+
+    // Record the data bit offset of the next indexed frame (frames 0,
+    // stride, 2*stride, ... in order)
+    void add_index(uint64_t bit_offset) { index_.push_back(bit_offset); }
+
+    // Write the padding, index and trailer, and patch the header
+    void finish();
+
+    bool ok() const { return ok_; }
+    uint64_t bits() const { return bits_; }
+
+    // Hand full buffers to `sink` rather than writing `fd`; the header is
+    // still patched through `fd` once the sink has written everything
+    void set_sink(ByteSink* sink) { sink_ = sink; }
+
+private:
+    int      fd_;
+    bool     ok_;
+    bool     finished_;
+    ContainerHeader header_;
+    int64_t  base_;             // file offset of the header, -1 if not seekable
+    uint64_t bits_;
+    uint64_t carry_;            // bits not yet making up a whole word
+    unsigned ncarry_;
+    std::vector<char> buf_;
+    size_t   used_;
+    std::vector<uint64_t> index_;
+    ByteSink* sink_;
+
+    void put_word(uint64_t w);
+    void put(const void* p, size_t n);
+    void flush();
+};
+
+// Reads the data of a container sequentially. With a seekable descriptor it
+// also serves arbitrary bit ranges and the frame index.
+class ContainerReader {
+public:
+    // The header has already been read from `fd` and parsed into `header`
+    ContainerReader(int fd, const ContainerHeader& header, size_t block_bytes = BLOCK_BYTES);
+
+    // False when the container is malformed. A length missing from the
+    // header is looked up in the trailer, which on a pipe is only reached
+    // at the end: check ok() again once read() returns false.
+    bool ok() const { return ok_; }
+    const ContainerHeader& header() const { return header_; }
+
+    // Replace `bits` with the next block of data; false at the end
+    bool read(BitBuffer& bits);
+
+    // Append data bits [pos, pos + len) to `bits` (seekable input only)
+    bool read_range(uint64_t pos, uint64_t len, BitBuffer& bits) const;
+
+    // Load the frame index (seekable input only)
+    bool read_index(std::vector<uint64_t>& index) const;
+
+    // Take the data from `source` rather than reading `fd`; the ranged
+    // reads above still go to `fd`
+    void set_source(ByteSource* source) { source_ = source; }
+
+private:
+    int      fd_;
+    bool     ok_;
+    ContainerHeader header_;
+    int64_t  base_;             // file offset of the header, -1 if not seekable
+    uint64_t bytes_left_;
+    uint64_t bits_left_;
+    std::vector<char> buf_;
+    bool     until_eof_;        // length unknown: read to the end, holding back
+    size_t   held_;             // the trailer and the last data byte
+    uint64_t bits_read_;
+    ByteSource* source_;
+    std::vector<char> block_;   // last block from source_, when holding back
+
+    size_t read_some(size_t want);
+    bool read_until_eof(BitBuffer& bits);
+};
+
+// Sequential input that is either '0'/'1' text or a container; the format
+// is recognised from the first bytes
+class BitInput {
+public:
+    explicit BitInput(int fd);
+
+    // See ContainerReader::ok()
+    bool ok() const;
+    bool binary() const { return bin_ != nullptr; }
+    const ContainerHeader& header() const;
+
+    bool read(BitBuffer& bits);
+
+    // See BitReader::set_source() and ContainerReader::set_source()
+    void set_source(ByteSource* source);
+
+private:
+    bool ok_;
+    ContainerHeader header_;
+    std::unique_ptr<BitReader> text_;
+    std::unique_ptr<ContainerReader> bin_;
+};
+
+// Sequential output in either format
+class BitOutput {
+public:
+    BitOutput(int fd, bool binary, const ContainerHeader& header);
+
+    void write(const BitSpan& bits);
+    void add_index(uint64_t bit_offset);    // ignored for text
+    void finish();
+    bool ok() const;
+
+    // See BitWriter::set_sink() and ContainerWriter::set_sink()
+    void set_sink(ByteSink* sink);
+
+private:
+    std::unique_ptr<BitWriter> text_;
+    std::unique_ptr<ContainerWriter> bin_;
+};
+
+// Load a whole file in either format. `header`, if given, receives the
+// container header (default-constructed for text). A malformed or truncated
+// container loads as empty and sets `*malformed`; a missing file is just
+// empty, as with read_bitfile().
+BitBuffer load_bits(const std::string& path, ContainerHeader* header = nullptr,
+                    bool* malformed = nullptr);
+
+// Save a whole stream as text or as a container with the given index
+bool save_bits(const std::string& path, const BitSpan& bits, bool binary,
+               const ContainerHeader& header, const std::vector<uint64_t>& index);
+
+#endif // CONTAINER_H
@@ -0,0 +1,163 @@
+// crc.cpp
+#include "crc.h"
+#include "crc16.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC_X86_64 1
+#endif
+
+namespace {
+
+#ifdef CRC_X86_64
+const bool have_sse42 = __builtin_cpu_supports("sse4.2");
+
+// The crc32 instruction is the reflected CRC-32C register update, with
+// the first byte in the low bits: exactly a byte-swapped stream word
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(uint32_t reg, const BitSpan& bits) {
+    typedef CrcEngine<Crc32c> E;
+    uint64_t r = reg;
+    size_t full = bits.size() / 64;
+    for (size_t k = 0; k < full; ++k) r = _mm_crc32_u64(r, __builtin_bswap64(bits.word(k)));
+    reg = static_cast<uint32_t>(r);
+    unsigned rest = bits.size() & 63;
+    if (rest == 0) return reg;
+    uint64_t w = bits.word(full);
+    unsigned i = 0;
+    for (; i + 8 <= rest; i += 8) reg = _mm_crc32_u8(reg, static_cast<uint8_t>(w >> (56 - i)));
+    for (; i < rest; ++i) reg = E::step_bit(reg, (w >> (63 - i)) & 1);
+    return reg;
+}
+#else
+const bool have_sse42 = false;
+#endif
+
+template <class Spec>
+uint64_t update_with(uint64_t reg, const BitSpan& bits) {
+    return CrcEngine<Spec>::update(static_cast<typename Spec::value_type>(reg), bits);
+}
+
+// The engine works on registers of the spec's own type
+template <class Spec>
+void update_many_with(uint64_t* regs, const BitSpan* bits, size_t n) {
+    typedef typename Spec::value_type T;
+    const size_t BLOCK = 64;
+    T r[BLOCK];
+    for (size_t i = 0; i < n; i += BLOCK) {
+        size_t m = std::min(BLOCK, n - i);
+        for (size_t j = 0; j < m; ++j) r[j] = static_cast<T>(regs[i + j]);
+        CrcEngine<Spec>::update_many(r, bits + i, m);
+        for (size_t j = 0; j < m; ++j) regs[i + j] = r[j];
+    }
+}
+
+// update_many() one string at a time. The table engine's lanes only pay
+// where a single short update is slowed by more than its dependency chain
+// (the CRC-16 engines' set-up); for CRC-32 and the crc32 instruction the
+// CPU already overlaps consecutive short updates, and the lanes cost more
+// than they save.
+template <class Spec>
+void update_each_with(uint64_t* regs, const BitSpan* bits, size_t n) {
+    for (size_t i = 0; i < n; ++i) regs[i] = update_with<Spec>(regs[i], bits[i]);
+}
+
+template <class Spec>
+uint64_t finish_with(uint64_t reg) {
+    return CrcEngine<Spec>::finish(static_cast<typename Spec::value_type>(reg));
+}
+
+template <class Spec>
+uint64_t shift_with(uint64_t reg, uint64_t nbits) {
+    return CrcEngine<Spec>::shift(static_cast<typename Spec::value_type>(reg), nbits);
+}
+
+template <class Spec>
+uint64_t combine_with(uint64_t crc_a, uint64_t crc_b, uint64_t len_b) {
+    typedef typename Spec::value_type T;
+    return CrcEngine<Spec>::combine(static_cast<T>(crc_a), static_cast<T>(crc_b), len_b);
+}
+
+} // namespace
+
+// The register of Crc16Framing is the crc16.h running value, so its
+// slicing / carry-less engines can stand in for the tables
+bool CrcAccel<Crc16Framing>::update(uint16_t& reg, const BitSpan& bits) {
+    reg = crc16_update(reg, bits);
+    return true;
+}
+
+bool CrcAccel<Crc32c>::update(uint32_t& reg, const BitSpan& bits) {
+#ifdef CRC_X86_64
+    if (have_sse42) {
+        reg = crc32c_sse42(reg, bits);
+        return true;
+    }
+#endif
+    (void)reg;
+    (void)bits;
+    return false;
+}
+
+bool crc32c_have_sse42() {
+    return have_sse42;
+}
+
+FrameCrc::FrameCrc(CrcVariant variant)
+    : variant_(variant)
+{
+    switch (variant) {
+    case CrcVariant::CRC32:
+        width_  = Crc32::width();
+        start_  = CrcEngine<Crc32>::start();
+        update_ = update_with<Crc32>;
+        update_many_ = update_each_with<Crc32>;
+        finish_ = finish_with<Crc32>;
+        shift_  = shift_with<Crc32>;
+        combine_ = combine_with<Crc32>;
+        break;
+    case CrcVariant::CRC32C:
+        width_  = Crc32c::width();
+        start_  = CrcEngine<Crc32c>::start();
+        update_ = update_with<Crc32c>;
+        update_many_ = update_each_with<Crc32c>;
+        finish_ = finish_with<Crc32c>;
+        shift_  = shift_with<Crc32c>;
+        combine_ = combine_with<Crc32c>;
+        break;
+    default:
+        variant_ = CrcVariant::CRC16_CCITT;
+        width_  = Crc16Framing::width();
+        start_  = CrcEngine<Crc16Framing>::start();
+        update_ = update_with<Crc16Framing>;
+        update_many_ = update_many_with<Crc16Framing>;
+        finish_ = finish_with<Crc16Framing>;
+        shift_  = shift_with<Crc16Framing>;
+        combine_ = combine_with<Crc16Framing>;
+        break;
+    }
+}
+
+bool crc_variant_known(CrcVariant variant) {
+    return variant == CrcVariant::CRC16_CCITT || variant == CrcVariant::CRC32
+        || variant == CrcVariant::CRC32C;
+}
+
+const char* crc_variant_name(CrcVariant variant) {
+    switch (variant) {
+    case CrcVariant::CRC16_CCITT: return "crc16";
+    case CrcVariant::CRC32:       return "crc32";
+    case CrcVariant::CRC32C:      return "crc32c";
+    }
+    return "unknown";
+}
+
+bool parse_crc_variant(const std::string& name, CrcVariant& variant) {
+    const CrcVariant all[] = {CrcVariant::CRC16_CCITT, CrcVariant::CRC32, CrcVariant::CRC32C};
+    for (CrcVariant v : all)
+        if (name == crc_variant_name(v)) {
+            variant = v;
+            return true;
+        }
+    return false;
+}
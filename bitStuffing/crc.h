@@ -0,0 +1,400 @@
+// crc.h
+#ifndef CRC_H
+#define CRC_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include "bitbuffer.h"
+
+// CRCs a frame can carry; the number is what the container header stores
+enum class CrcVariant : uint8_t {
+    CRC16_CCITT = 0,    // the original framing CRC, see Crc16Framing
+    CRC32       = 1,
+    CRC32C      = 2
+};
+
+// A CRC in the usual parameter model: width, polynomial (normal form,
+// without the top bit), initial register, input/output reflection and
+// final xor. `Augment` shifts `Width` zero bits through the register before
+// the output step, as the original framing code did.
+//
+// Bits are taken from the stream as MSB-first bytes: with RefIn each whole
+// byte is fed least significant bit first, as byte-oriented CRC-32 code
+// would see the packed stream; bits after the last whole byte go in stream
+// order.
+template <unsigned Width, uint64_t Poly, uint64_t Init, bool RefIn, bool RefOut,
+          uint64_t XorOut, bool Augment = false>
+struct CrcSpec {
+    static_assert(Width >= 8 && Width <= 64, "CRC width must be 8..64 bits");
+    static_assert(!Augment || Width % 8 == 0, "augmented CRCs must be whole bytes wide");
+
+    typedef typename std::conditional<(Width <= 16), uint16_t,
+            typename std::conditional<(Width <= 32), uint32_t, uint64_t>::type>::type value_type;
+
+    static constexpr unsigned width()  { return Width; }
+    static constexpr uint64_t poly()   { return Poly; }
+    static constexpr uint64_t init()   { return Init; }
+    static constexpr bool     ref_in() { return RefIn; }
+    static constexpr bool     ref_out() { return RefOut; }
+    static constexpr uint64_t xor_out() { return XorOut; }
+    static constexpr bool     augment() { return Augment; }
+};
+
+// CRC-16-CCITT as the framing tools have always computed it: poly 0x1021,
+// init 0xFFFF, MSB-first, then 16 zero bits
+typedef CrcSpec<16, 0x1021, 0xFFFF, false, false, 0, true> Crc16Framing;
+
+// CRC-32 (IEEE 802.3 / zlib) and CRC-32C (Castagnoli, iSCSI)
+typedef CrcSpec<32, 0x04C11DB7, 0xFFFFFFFF, true, true, 0xFFFFFFFF> Crc32;
+typedef CrcSpec<32, 0x1EDC6F41, 0xFFFFFFFF, true, true, 0xFFFFFFFF> Crc32c;
+
+namespace crc_detail {
+
+constexpr uint64_t mask(unsigned width) {
+    return width >= 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+}
+
+constexpr uint64_t reflect(uint64_t v, unsigned width) {
+    uint64_t r = 0;
+    for (unsigned i = 0; i < width; ++i)
+        if (v & (uint64_t(1) << i)) r |= uint64_t(1) << (width - 1 - i);
+    return r;
+}
+
+// Slicing-by-8 tables: t[k][b] is the register contribution of byte b
+// followed by k zero bytes
+template <class T>
+struct Tables {
+    T t[8][256];
+};
+
+template <class Spec>
+constexpr Tables<typename Spec::value_type> make_tables() {
+    typedef typename Spec::value_type T;
+    const unsigned w = Spec::width();
+    const uint64_t m = mask(w);
+    const uint64_t rpoly = reflect(Spec::poly(), w);
+    Tables<T> r{};
+    for (unsigned b = 0; b < 256; ++b) {
+        uint64_t reg = 0;
+        if (Spec::ref_in()) {
+            reg = b;
+            for (unsigned i = 0; i < 8; ++i) reg = (reg & 1) ? (reg >> 1) ^ rpoly : reg >> 1;
+        } else {
+            reg = uint64_t(b) << (w - 8);
+            for (unsigned i = 0; i < 8; ++i)
+                reg = ((reg >> (w - 1)) & 1) ? ((reg << 1) ^ Spec::poly()) & m : (reg << 1) & m;
+        }
+        r.t[0][b] = static_cast<T>(reg);
+    }
+    for (unsigned k = 1; k < 8; ++k)
+        for (unsigned b = 0; b < 256; ++b) {
+            uint64_t prev = r.t[k - 1][b];
+            uint64_t next = Spec::ref_in()
+                ? (prev >> 8) ^ r.t[0][prev & 0xFF]
+                : ((prev << 8) & m) ^ r.t[0][(prev >> (w - 8)) & 0xFF];
+            r.t[k][b] = static_cast<T>(next);
+        }
+    return r;
+}
+
+// a * b mod (x^w + poly), both in normal (MSB-first) form
+constexpr uint64_t mulmod(uint64_t a, uint64_t b, uint64_t poly, unsigned w) {
+    uint64_t r = 0;
+    for (unsigned i = w; i-- > 0;) {
+        bool top = ((r >> (w - 1)) & 1) != 0;
+        r = (r << 1) & mask(w);
+        if (top) r ^= poly;
+        if ((a >> i) & 1) r ^= b;
+    }
+    return r;
+}
+
+// p[k] = x^(2^k) mod P: feeding n zero bits multiplies the register by
+// x^n, which is the product of the p[k] for the bits k set in n
+template <class T>
+struct Powers {
+    T p[64];
+};
+
+template <class Spec>
+constexpr Powers<typename Spec::value_type> make_powers() {
+    typedef typename Spec::value_type T;
+    Powers<T> r{};
+    uint64_t x = 2;
+    for (unsigned k = 0; k < 64; ++k) {
+        r.p[k] = static_cast<T>(x);
+        x = mulmod(x, x, Spec::poly(), Spec::width());
+    }
+    return r;
+}
+
+} // namespace crc_detail
+
+// Optional faster update for one CRC (hardware instruction or a dedicated
+// engine). Returns false when it cannot run, and the table engine is used.
+template <class Spec>
+struct CrcAccel {
+    static bool update(typename Spec::value_type&, const BitSpan&) { return false; }
+};
+
+template <> struct CrcAccel<Crc16Framing> {
+    static bool update(uint16_t& reg, const BitSpan& bits);     // crc16.h engines
+};
+
+template <> struct CrcAccel<Crc32c> {
+    static bool update(uint32_t& reg, const BitSpan& bits);     // SSE4.2 crc32
+};
+
+// Independent register chains CrcEngine::update_many() runs side by side,
+// and the length from which a string is left to a chain of its own: by
+// then the chain is long enough to keep the CPU busy, and a CrcAccel
+// engine, when there is one, is faster than the tables
+const unsigned CRC_LANES     = 4;
+const size_t   CRC_MANY_BITS = 512;
+
+// Table-driven engine for one CrcSpec; the tables are built at compile time.
+// The register is kept in the algorithm's native orientation (reflected
+// for RefIn CRCs); finish() turns it into the CRC value.
+template <class Spec>
+class CrcEngine {
+public:
+    typedef typename Spec::value_type value_type;
+    static constexpr unsigned W = Spec::width();
+
+    static constexpr value_type start() {
+        return static_cast<value_type>(Spec::ref_in() ? crc_detail::reflect(Spec::init(), W)
+                                                      : Spec::init());
+    }
+
+    // Feed bits, through CrcAccel when it is available
+    static value_type update(value_type reg, const BitSpan& bits) {
+        if (CrcAccel<Spec>::update(reg, bits)) return reg;
+        return update_tables(reg, bits);
+    }
+
+    // Feed bits with slicing-by-8 tables only
+    static value_type update_tables(value_type reg, const BitSpan& bits) {
+        size_t full = bits.size() / 64;
+        for (size_t k = 0; k < full; ++k) reg = step_word(reg, bits.word(k));
+        unsigned rest = bits.size() & 63;
+        if (rest == 0) return reg;
+        uint64_t w = bits.word(full);
+        unsigned i = 0;
+        for (; i + 8 <= rest; i += 8) reg = step_byte(reg, static_cast<uint8_t>(w >> (56 - i)));
+        for (; i < rest; ++i) reg = step_bit(reg, (w >> (63 - i)) & 1);
+        return reg;
+    }
+
+    // update() of several independent bit strings: regs[i] takes bits[i].
+    // Short strings are run in groups of CRC_LANES, word by word together,
+    // so the table lookups of one register chain overlap those of the
+    // others instead of waiting on their own previous step; what is left of
+    // each past the shortest one, and the strings short of a last group,
+    // finish on their own. Strings of CRC_MANY_BITS or more go through
+    // update().
+    static void update_many(value_type* regs, const BitSpan* bits, size_t n) {
+        size_t group[CRC_LANES];
+        unsigned m = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (bits[i].size() >= CRC_MANY_BITS) {
+                regs[i] = update(regs[i], bits[i]);
+                continue;
+            }
+            group[m++] = i;
+            if (m < CRC_LANES) continue;
+            m = 0;
+            BitSpan    s[CRC_LANES];
+            value_type r[CRC_LANES];
+            size_t common = CRC_MANY_BITS / 64;
+            for (unsigned j = 0; j < CRC_LANES; ++j) {
+                s[j] = bits[group[j]];
+                r[j] = regs[group[j]];
+                common = std::min(common, s[j].size() / 64);
+            }
+            for (size_t k = 0; k < common; ++k)
+                for (unsigned j = 0; j < CRC_LANES; ++j)
+                    r[j] = step_word(r[j], s[j].bits(k * 64, 64));
+            for (unsigned j = 0; j < CRC_LANES; ++j)
+                regs[group[j]] = update_tables(r[j], s[j].subspan(common * 64));
+        }
+        for (unsigned j = 0; j < m; ++j)
+            regs[group[j]] = update_tables(regs[group[j]], bits[group[j]]);
+    }
+
+    // Output step: augmentation, output reflection, final xor
+    static value_type finish(value_type reg) {
+        if (Spec::augment())
+            for (unsigned i = 0; i < W / 8; ++i) reg = step_byte(reg, 0);
+        uint64_t v = reg;
+        if (Spec::ref_in() != Spec::ref_out()) v = crc_detail::reflect(v, W);
+        return static_cast<value_type>(v ^ Spec::xor_out());
+    }
+
+    static value_type compute(const BitSpan& bits) { return finish(update(start(), bits)); }
+
+    // The register after `nbits` zero bits, in O(log nbits). The update is
+    // linear, so update(reg, B) == shift(reg, |B|) ^ update(0, B): slices of
+    // a frame can be fed from 0 on separate threads and joined with this.
+    static value_type shift(value_type reg, uint64_t nbits) {
+        uint64_t r = Spec::ref_in() ? crc_detail::reflect(reg, W) : reg;
+        for (unsigned k = 0; nbits; ++k, nbits >>= 1)
+            if (nbits & 1) r = crc_detail::mulmod(r, powers.p[k], Spec::poly(), W);
+        return static_cast<value_type>(Spec::ref_in() ? crc_detail::reflect(r, W) : r);
+    }
+
+    // compute(A + B) from compute(A), compute(B) and the length of B in
+    // bits; for reflected CRCs A must be whole bytes
+    static value_type combine(value_type crc_a, value_type crc_b, uint64_t len_b) {
+        // Back to registers (after augmentation, which commutes with the
+        // shift): reg(A + B) = shift(reg(A) ^ start, len_b) ^ reg(B)
+        value_type s = start();
+        if (Spec::augment()) s = shift(s, W);
+        value_type r = shift(unfinish(crc_a) ^ s, len_b) ^ unfinish(crc_b);
+        uint64_t v = r;
+        if (Spec::ref_in() != Spec::ref_out()) v = crc_detail::reflect(v, W);
+        return static_cast<value_type>(v ^ Spec::xor_out());
+    }
+
+    // Eight stream bytes packed MSB-first in a word
+    static value_type step_word(value_type reg, uint64_t w) {
+        const auto& t = tables.t;
+        uint64_t x;
+        if (Spec::ref_in()) {
+            x = __builtin_bswap64(w) ^ reg;
+            return t[7][x & 0xFF] ^ t[6][(x >> 8) & 0xFF] ^ t[5][(x >> 16) & 0xFF]
+                 ^ t[4][(x >> 24) & 0xFF] ^ t[3][(x >> 32) & 0xFF] ^ t[2][(x >> 40) & 0xFF]
+                 ^ t[1][(x >> 48) & 0xFF] ^ t[0][x >> 56];
+        }
+        x = w ^ (W == 64 ? uint64_t(reg) : uint64_t(reg) << (64 - W) % 64);
+        return t[7][x >> 56] ^ t[6][(x >> 48) & 0xFF] ^ t[5][(x >> 40) & 0xFF]
+             ^ t[4][(x >> 32) & 0xFF] ^ t[3][(x >> 24) & 0xFF] ^ t[2][(x >> 16) & 0xFF]
+             ^ t[1][(x >> 8) & 0xFF] ^ t[0][x & 0xFF];
+    }
+
+    static value_type step_byte(value_type reg, uint8_t b) {
+        const auto& t0 = tables.t[0];
+        if (Spec::ref_in()) return static_cast<value_type>((uint64_t(reg) >> 8) ^ t0[(reg ^ b) & 0xFF]);
+        return static_cast<value_type>(((uint64_t(reg) << 8) & crc_detail::mask(W))
+                                       ^ t0[((reg >> (W - 8)) ^ b) & 0xFF]);
+    }
+
+    static value_type step_bit(value_type reg, unsigned b) {
+        uint64_t r = reg;
+        if (Spec::ref_in()) {
+            bool low = ((r ^ b) & 1) != 0;
+            r >>= 1;
+            if (low) r ^= crc_detail::reflect(Spec::poly(), W);
+        } else {
+            bool top = (((r >> (W - 1)) ^ b) & 1) != 0;
+            r = (r << 1) & crc_detail::mask(W);
+            if (top) r ^= Spec::poly();
+        }
+        return static_cast<value_type>(r);
+    }
+
+    // Bit-at-a-time CRC of whole bytes, usable in constant expressions
+    static constexpr value_type check(const char* s, size_t len) {
+        uint64_t r = start();
+        for (size_t i = 0; i < len; ++i)
+            for (unsigned j = 0; j < 8; ++j) {
+                unsigned b = Spec::ref_in() ? (static_cast<unsigned char>(s[i]) >> j) & 1
+                                            : (static_cast<unsigned char>(s[i]) >> (7 - j)) & 1;
+                if (Spec::ref_in()) {
+                    bool low = ((r ^ b) & 1) != 0;
+                    r >>= 1;
+                    if (low) r ^= crc_detail::reflect(Spec::poly(), W);
+                } else {
+                    bool top = (((r >> (W - 1)) ^ b) & 1) != 0;
+                    r = (r << 1) & crc_detail::mask(W);
+                    if (top) r ^= Spec::poly();
+                }
+            }
+        for (unsigned i = 0; Spec::augment() && i < W; ++i) {
+            bool top = ((r >> (W - 1)) & 1) != 0;
+            r = (r << 1) & crc_detail::mask(W);
+            if (top) r ^= Spec::poly();
+        }
+        if (Spec::ref_in() != Spec::ref_out()) r = crc_detail::reflect(r, W);
+        return static_cast<value_type>(r ^ Spec::xor_out());
+    }
+
+private:
+    static constexpr crc_detail::Tables<value_type> tables = crc_detail::make_tables<Spec>();
+    static constexpr crc_detail::Powers<value_type> powers = crc_detail::make_powers<Spec>();
+
+    // finish() without the augmentation: CRC value back to a register
+    static value_type unfinish(value_type crc) {
+        uint64_t v = crc ^ Spec::xor_out();
+        if (Spec::ref_in() != Spec::ref_out()) v = crc_detail::reflect(v, W);
+        return static_cast<value_type>(v);
+    }
+};
+
+template <class Spec>
+constexpr crc_detail::Tables<typename Spec::value_type> CrcEngine<Spec>::tables;
+
+template <class Spec>
+constexpr crc_detail::Powers<typename Spec::value_type> CrcEngine<Spec>::powers;
+
+template <class Spec>
+constexpr unsigned CrcEngine<Spec>::W;
+
+// The catalogue check values, verified while compiling; 0x0B84 is what
+// crc16_ccitt() has always returned for the same input
+static_assert(CrcEngine<Crc16Framing>::check("123456789", 9) == 0x0B84, "framing CRC-16 check value");
+static_assert(CrcEngine<Crc32>::check("123456789", 9) == 0xCBF43926, "CRC-32 check value");
+static_assert(CrcEngine<Crc32c>::check("123456789", 9) == 0xE3069283, "CRC-32C check value");
+
+// A CrcVariant picked at run time. The framing code keeps the register in a
+// uint64_t and calls through this; values are appended to frames MSB-first
+// in width() bits. For reflected CRCs only the last update() of a frame may
+// end inside a byte.
+class FrameCrc {
+public:
+    explicit FrameCrc(CrcVariant variant = CrcVariant::CRC16_CCITT);
+
+    CrcVariant variant() const { return variant_; }
+    unsigned width() const { return width_; }
+
+    uint64_t start() const { return start_; }
+    uint64_t update(uint64_t reg, const BitSpan& bits) const { return update_(reg, bits); }
+    uint64_t finish(uint64_t reg) const { return finish_(reg); }
+    uint64_t compute(const BitSpan& bits) const { return finish(update(start(), bits)); }
+
+    // See CrcEngine::update_many()
+    void update_many(uint64_t* regs, const BitSpan* bits, size_t n) const {
+        update_many_(regs, bits, n);
+    }
+
+    // See CrcEngine::shift() and CrcEngine::combine()
+    uint64_t shift(uint64_t reg, uint64_t nbits) const { return shift_(reg, nbits); }
+    uint64_t combine(uint64_t crc_a, uint64_t crc_b, uint64_t len_b) const {
+        return combine_(crc_a, crc_b, len_b);
+    }
+
+private:
+    CrcVariant variant_;
+    unsigned   width_;
+    uint64_t   start_;
+    uint64_t (*update_)(uint64_t, const BitSpan&);
+    void     (*update_many_)(uint64_t*, const BitSpan*, size_t);
+    uint64_t (*finish_)(uint64_t);
+    uint64_t (*shift_)(uint64_t, uint64_t);
+    uint64_t (*combine_)(uint64_t, uint64_t, uint64_t);
+};
+
+// True for the variants FrameCrc knows
+bool crc_variant_known(CrcVariant variant);
+
+// "crc16", "crc32", "crc32c"
+const char* crc_variant_name(CrcVariant variant);
+bool parse_crc_variant(const std::string& name, CrcVariant& variant);
+
+// True when CRC-32C runs on the SSE4.2 crc32 instruction on this CPU
+bool crc32c_have_sse42();
+
+#endif // CRC_H
@@ -0,0 +1,294 @@
+// crc16.cpp
+#include "crc16.h"
+#include "crc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC16_X86 1
+#endif
+
+namespace {
+
+// x^n mod P, used for the carry-less folding constants
+uint16_t xpow_mod(unsigned n) {
+    uint32_t r = 1;
+    for (unsigned i = 0; i < n; ++i) {
+        r <<= 1;
+        if (r & 0x10000) r ^= 0x10000 | CRC16_POLY;
+    }
+    return static_cast<uint16_t>(r);
+}
+
+// Slicing tables: T[k][b] is the CRC contribution of byte b followed by k
+// zero bytes. T[0] is the classic byte-at-a-time table.
+struct Tables {
+    uint16_t T[8][256];
+    uint16_t fold128;   // x^128 mod P
+    uint16_t fold192;   // x^192 mod P
+    uint16_t fold512;   // x^512 mod P
+    uint16_t fold576;   // x^576 mod P
+    uint16_t fold256;   // x^256 mod P
+    uint16_t fold320;   // x^320 mod P
+    uint16_t fold384;   // x^384 mod P
+    uint16_t fold448;   // x^448 mod P
+    bool     clmul;
+
+    Tables() {
+        for (int b = 0; b < 256; ++b) {
+            uint16_t crc = static_cast<uint16_t>(b << 8);
+            for (int i = 0; i < 8; ++i)
+                crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ CRC16_POLY)
+                                     : static_cast<uint16_t>(crc << 1);
+            T[0][b] = crc;
+        }
+        for (int k = 1; k < 8; ++k)
+            for (int b = 0; b < 256; ++b) {
+                uint16_t prev = T[k-1][b];
+                T[k][b] = static_cast<uint16_t>((prev << 8) ^ T[0][prev >> 8]);
+            }
+        fold128 = xpow_mod(128);
+        fold192 = xpow_mod(192);
+        fold256 = xpow_mod(256);
+        fold320 = xpow_mod(320);
+        fold384 = xpow_mod(384);
+        fold448 = xpow_mod(448);
+        fold512 = xpow_mod(512);
+        fold576 = xpow_mod(576);
+#ifdef CRC16_X86
+        clmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+#else
+        clmul = false;
+#endif
+    }
+};
+
+const Tables tables;
+
+inline uint16_t step_byte(uint16_t crc, uint8_t byte) {
+    return static_cast<uint16_t>((crc << 8) ^ tables.T[0][(crc >> 8) ^ byte]);
+}
+
+} // namespace
+
+// Reference engine: one bit per iteration, the algorithm the tools started with
+uint16_t crc16_update_bitwise(uint16_t crc, const uint8_t* data, size_t nbits) {
+    for (size_t i = 0; i < nbits; ++i) {
+        bool bit = (data[i >> 3] >> (7 - (i & 7))) & 1;
+        bool msb = (crc >> 15) & 1;
+        crc = static_cast<uint16_t>(crc << 1);
+        if (bit ^ msb) crc ^= CRC16_POLY;
+    }
+    return crc;
+}
+
+// One table lookup per byte
+uint16_t crc16_update_bytewise(uint16_t crc, const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; ++i)
+        crc = step_byte(crc, data[i]);
+    return crc;
+}
+
+// Eight independent table lookups per 8-byte block
+uint16_t crc16_update_slice8(uint16_t crc, const uint8_t* data, size_t len) {
+    const uint16_t (*T)[256] = tables.T;
+    while (len >= 8) {
+        uint8_t b0 = data[0] ^ static_cast<uint8_t>(crc >> 8);
+        uint8_t b1 = data[1] ^ static_cast<uint8_t>(crc);
+        crc = T[7][b0] ^ T[6][b1] ^ T[5][data[2]] ^ T[4][data[3]]
+            ^ T[3][data[4]] ^ T[2][data[5]] ^ T[1][data[6]] ^ T[0][data[7]];
+        data += 8;
+        len  -= 8;
+    }
+    return crc16_update_bytewise(crc, data, len);
+}
+
+// Slicing-by-8 over MSB-first words: each word is exactly one 8-byte block
+uint16_t crc16_update_words_slice8(uint16_t crc, const uint64_t* words, size_t nwords) {
+    const uint16_t (*T)[256] = tables.T;
+    for (size_t i = 0; i < nwords; ++i) {
+        uint64_t w = words[i] ^ (uint64_t(crc) << 48);
+        crc = T[7][w >> 56]         ^ T[6][(w >> 48) & 0xFF]
+            ^ T[5][(w >> 40) & 0xFF] ^ T[4][(w >> 32) & 0xFF]
+            ^ T[3][(w >> 24) & 0xFF] ^ T[2][(w >> 16) & 0xFF]
+            ^ T[1][(w >> 8) & 0xFF]  ^ T[0][w & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef CRC16_X86
+
+namespace {
+
+// Loaders return 16 bytes of message as a polynomial, first bit in bit 127
+struct ByteLoader {
+    typedef uint8_t unit;
+    static const size_t per_block = 16;
+    __attribute__((target("pclmul,ssse3")))
+    static __m128i load(const uint8_t* p) {
+        const __m128i rev = _mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+        return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), rev);
+    }
+    static uint16_t tail(uint16_t crc, const uint8_t* p, size_t n) {
+        return crc16_update_slice8(crc, p, n);
+    }
+};
+
+struct WordLoader {
+    typedef uint64_t unit;
+    static const size_t per_block = 2;
+    __attribute__((target("pclmul,ssse3")))
+    static __m128i load(const uint64_t* p) {
+        return _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), 0x4E);
+    }
+    static uint16_t tail(uint16_t crc, const uint64_t* p, size_t n) {
+        return crc16_update_words_slice8(crc, p, n);
+    }
+};
+
+// acc * x^(distance) folded down to at most 80 bits, using k = (x^(d+64), x^d) mod P
+__attribute__((target("pclmul,ssse3")))
+inline __m128i fold(__m128i acc, __m128i k) {
+    return _mm_xor_si128(_mm_clmulepi64_si128(acc, k, 0x11),
+                         _mm_clmulepi64_si128(acc, k, 0x00));
+}
+
+// Needs at least one full 16-byte block
+template <class L>
+__attribute__((target("pclmul,ssse3")))
+uint16_t clmul_impl(uint16_t crc, const typename L::unit* data, size_t len) {
+    const size_t B = L::per_block;
+    const __m128i k1  = _mm_set_epi64x(tables.fold192, tables.fold128);
+    const __m128i k2  = _mm_set_epi64x(tables.fold320, tables.fold256);
+    const __m128i k3  = _mm_set_epi64x(tables.fold448, tables.fold384);
+    const __m128i k4  = _mm_set_epi64x(tables.fold576, tables.fold512);
+
+    // Folding in the running CRC: crc * x^n == (crc * x^(n-16)) * x^16, so
+    // it is simply XORed into the first 16 message bits.
+    __m128i acc = _mm_xor_si128(L::load(data),
+                                _mm_set_epi64x(static_cast<int64_t>(uint64_t(crc) << 48), 0));
+    data += B;
+    len  -= B;
+
+    if (len >= 4 * B) {
+        __m128i a0 = acc;
+        __m128i a1 = L::load(data);
+        __m128i a2 = L::load(data + B);
+        __m128i a3 = L::load(data + 2 * B);
+        data += 3 * B;
+        len  -= 3 * B;
+        while (len >= 4 * B) {
+            a0 = _mm_xor_si128(fold(a0, k4), L::load(data));
+            a1 = _mm_xor_si128(fold(a1, k4), L::load(data + B));
+            a2 = _mm_xor_si128(fold(a2, k4), L::load(data + 2 * B));
+            a3 = _mm_xor_si128(fold(a3, k4), L::load(data + 3 * B));
+            data += 4 * B;
+            len  -= 4 * B;
+        }
+        acc = _mm_xor_si128(_mm_xor_si128(fold(a0, k3), fold(a1, k2)),
+                            _mm_xor_si128(fold(a2, k1), a3));
+    }
+    while (len >= B) {
+        acc = _mm_xor_si128(fold(acc, k1), L::load(data));
+        data += B;
+        len  -= B;
+    }
+
+    // acc is congruent to everything folded so far; reduce it through the table
+    const __m128i rev = _mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+    uint8_t buf[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(buf), _mm_shuffle_epi8(acc, rev));
+    crc = crc16_update_slice8(0, buf, 16);
+    return L::tail(crc, data, len);
+}
+
+} // namespace
+
+// Carry-less multiply folding over 16-byte blocks (PCLMULQDQ)
+uint16_t crc16_update_clmul(uint16_t crc, const uint8_t* data, size_t len) {
+    if (len < 16 || !tables.clmul) return crc16_update_slice8(crc, data, len);
+    return clmul_impl<ByteLoader>(crc, data, len);
+}
+
+uint16_t crc16_update_words_clmul(uint16_t crc, const uint64_t* words, size_t nwords) {
+    if (nwords < 2 || !tables.clmul) return crc16_update_words_slice8(crc, words, nwords);
+    return clmul_impl<WordLoader>(crc, words, nwords);
+}
+
+#else
+
+uint16_t crc16_update_clmul(uint16_t crc, const uint8_t* data, size_t len) {
+    return crc16_update_slice8(crc, data, len);
+}
+
+uint16_t crc16_update_words_clmul(uint16_t crc, const uint64_t* words, size_t nwords) {
+    return crc16_update_words_slice8(crc, words, nwords);
+}
+
+#endif
+
+bool crc16_have_clmul() {
+    return tables.clmul;
+}
+
+const char* crc16_engine_name() {
+    return tables.clmul ? "clmul" : "slice8";
+}
+
+// Below 64 bytes the folding setup costs more than it saves
+uint16_t crc16_update(uint16_t crc, const uint8_t* data, size_t len) {
+    if (len >= 64 && tables.clmul) return crc16_update_clmul(crc, data, len);
+    return crc16_update_slice8(crc, data, len);
+}
+
+uint16_t crc16_update_words(uint16_t crc, const uint64_t* words, size_t nwords) {
+    if (nwords >= 8 && tables.clmul) return crc16_update_words_clmul(crc, words, nwords);
+    return crc16_update_words_slice8(crc, words, nwords);
+}
+
+uint16_t crc16_update_bits(uint16_t crc, const uint8_t* data, size_t nbits) {
+    size_t bytes = nbits >> 3;
+    crc = crc16_update(crc, data, bytes);
+    return crc16_update_bitwise(crc, data + bytes, nbits & 7);
+}
+
+uint16_t crc16_update(uint16_t crc, const BitSpan& bits) {
+    size_t full = bits.size() / 64;
+    if (bits.aligned()) {
+        crc = crc16_update_words(crc, bits.words(), full);
+    } else {
+        // Realign through a small stack buffer so the word engines still apply
+        uint64_t buf[64];
+        for (size_t k = 0; k < full; ) {
+            size_t n = full - k < 64 ? full - k : 64;
+            for (size_t j = 0; j < n; ++j) buf[j] = bits.word(k + j);
+            crc = crc16_update_words(crc, buf, n);
+            k += n;
+        }
+    }
+    unsigned rest = bits.size() & 63;
+    if (rest) {
+        uint64_t w = bits.word(full);
+        uint8_t tail[8];
+        for (int j = 0; j < 8; ++j) tail[j] = static_cast<uint8_t>(w >> (56 - 8 * j));
+        crc = crc16_update_bits(crc, tail, rest);
+    }
+    return crc;
+}
+
+// Two zero bytes through the table == 16 zero bits through the bit loop
+uint16_t crc16_finalize(uint16_t crc) {
+    crc = step_byte(crc, 0);
+    return step_byte(crc, 0);
+}
+
+uint16_t crc16_ccitt(const uint8_t* data, size_t nbits) {
+    return crc16_finalize(crc16_update_bits(CRC16_INIT, data, nbits));
+}
+
+uint16_t crc16_ccitt(const BitSpan& bits) {
+    return crc16_finalize(crc16_update(CRC16_INIT, bits));
+}
+
+uint16_t crc16_combine(uint16_t crc_a, uint16_t crc_b, size_t len_b) {
+    return CrcEngine<Crc16Framing>::combine(crc_a, crc_b, len_b);
+}
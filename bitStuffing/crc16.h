@@ -0,0 +1,54 @@
+// crc16.h
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <cstddef>
+#include <cstdint>
+#include "bitbuffer.h"
+
+// CRC-16-CCITT (poly 0x1021, init 0xFFFF), bits fed MSB-first and the
+// result finalized with 16 zero bits, exactly as the framing tools expect.
+const uint16_t CRC16_POLY = 0x1021;
+const uint16_t CRC16_INIT = 0xFFFF;
+
+// Feed whole bytes into a running CRC using the fastest engine on this CPU
+uint16_t crc16_update(uint16_t crc, const uint8_t* data, size_t len);
+
+// Feed whole MSB-first 64-bit words (the BitBuffer layout)
+uint16_t crc16_update_words(uint16_t crc, const uint64_t* words, size_t nwords);
+
+// Feed `nbits` bits packed MSB-first into bytes (last byte may be partial)
+uint16_t crc16_update_bits(uint16_t crc, const uint8_t* data, size_t nbits);
+
+// Feed a bit span of any length and starting offset
+uint16_t crc16_update(uint16_t crc, const BitSpan& bits);
+
+// Shift 16 zero bits through the register
+uint16_t crc16_finalize(uint16_t crc);
+
+// Complete CRC of `nbits` packed bits: init, update, finalize
+uint16_t crc16_ccitt(const uint8_t* data, size_t nbits);
+
+// Complete CRC of a bit span
+uint16_t crc16_ccitt(const BitSpan& bits);
+
+// crc16_ccitt(A followed by B) from crc16_ccitt(A), crc16_ccitt(B) and the
+// length of B in bits, without looking at the data again
+uint16_t crc16_combine(uint16_t crc_a, uint16_t crc_b, size_t len_b);
+
+// Individual engines, exposed so they can be checked against each other.
+// The clmul ones fall back to slicing-by-8 when the CPU lacks PCLMULQDQ.
+uint16_t crc16_update_bitwise(uint16_t crc, const uint8_t* data, size_t nbits);
+uint16_t crc16_update_bytewise(uint16_t crc, const uint8_t* data, size_t len);
+uint16_t crc16_update_slice8(uint16_t crc, const uint8_t* data, size_t len);
+uint16_t crc16_update_clmul(uint16_t crc, const uint8_t* data, size_t len);
+uint16_t crc16_update_words_slice8(uint16_t crc, const uint64_t* words, size_t nwords);
+uint16_t crc16_update_words_clmul(uint16_t crc, const uint64_t* words, size_t nwords);
+
+// True when the PCLMULQDQ engine can run on this CPU
+bool crc16_have_clmul();
+
+// Name of the engine crc16_update() dispatches to for large inputs
+const char* crc16_engine_name();
+
+#endif // CRC16_H
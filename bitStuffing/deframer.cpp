@@ -0,0 +1,351 @@
+// deframer.cpp
+#include "deframer.h"
+
+namespace {
+
+// Receiver state. While a run of 1s follows a 0 we track its exact length k
+// (0..6) and whether that 0 was itself dropped as a stuffed bit (z); that
+// is what flag detection and the closing-flag bookkeeping need. Runs of
+// seven or more can no longer end a flag, so only k mod 5 is kept for the
+// destuffer.
+inline unsigned S(unsigned k, unsigned z) { return 2 * k + z; }
+inline unsigned B(unsigned m) { return 14 + m; }
+const unsigned NSTATES = 19;
+const unsigned START   = 14;   // B(0): no 0 seen yet, so no flag can complete
+
+struct Step {
+    uint8_t next;
+    bool    emit;       // the bit survives destuffing
+    bool    flag;       // this 0 completes 01111110
+    bool    zdrop;      // the leading 0 of the flag (or of the run of seven)
+                        // was dropped by the destuffer
+    bool    abort;      // this 1 makes a run of seven
+};
+
+Step step(unsigned s, unsigned b) {
+    Step r = {0, true, false, false, false};
+    if (s < B(0)) {
+        unsigned k = s / 2, z = s & 1;
+        if (b) {
+            r.next  = static_cast<uint8_t>(k < 6 ? S(k + 1, z) : B(7 % 5));
+            r.abort = k == 6;
+            r.zdrop = z != 0;
+        } else {
+            bool dropped = (k == 5);
+            r.emit  = !dropped;
+            r.flag  = (k == 6);
+            r.zdrop = z != 0;
+            r.next  = static_cast<uint8_t>(S(0, dropped));
+        }
+    } else {
+        unsigned m = s - B(0);
+        if (b) {
+            r.next = static_cast<uint8_t>(B((m + 1) % 5));
+        } else {
+            bool dropped = (m == 0);
+            r.emit = !dropped;
+            r.next = static_cast<uint8_t>(S(0, dropped));
+        }
+    }
+    return r;
+}
+
+// (state, byte) -> destuffed bits, their count, next state. Bytes in which a
+// flag completes or a frame aborts are marked and handled bit by bit.
+struct Entry {
+    uint8_t bits;
+    uint8_t len;
+    uint8_t next;
+    uint8_t flag;
+    uint8_t abort;
+};
+
+struct Table {
+    Entry e[NSTATES][256];
+
+    Table() {
+        for (unsigned s = 0; s < NSTATES; ++s)
+            for (unsigned byte = 0; byte < 256; ++byte) {
+                unsigned st = s, bits = 0, len = 0, flag = 0, abort = 0;
+                for (int i = 7; i >= 0; --i) {
+                    Step r = step(st, (byte >> i) & 1);
+                    if (r.emit) { bits = (bits << 1) | ((byte >> i) & 1); ++len; }
+                    if (r.flag) flag = 1;
+                    if (r.abort) abort = 1;
+                    st = r.next;
+                }
+                e[s][byte] = Entry{static_cast<uint8_t>(bits), static_cast<uint8_t>(len),
+                                   static_cast<uint8_t>(st), static_cast<uint8_t>(flag),
+                                   static_cast<uint8_t>(abort)};
+            }
+    }
+};
+
+const Table table;
+
+// Open frames' CRCs are brought up to date in batches of at least this many
+// content bits (see feed_lagging)
+const size_t CRC_BATCH = 512;
+
+// Closed frames are verified together once there are CRC_LANES of them, or
+// once their content reaches this many bits; longer frames gain nothing
+// from waiting for company
+const size_t VERIFY_BITS = 4096;
+
+inline uint64_t five_ones(uint64_t w) {
+    return w & (w << 1) & (w << 2) & (w << 3) & (w << 4);
+}
+
+inline unsigned leading_ones(uint64_t w) {
+    return ~w ? static_cast<unsigned>(__builtin_clzll(~w)) : 64;
+}
+
+inline unsigned trailing_ones(uint64_t w) {
+    return ~w ? static_cast<unsigned>(__builtin_ctzll(~w)) : 64;
+}
+
+
+} // namespace
+
+void FrameCounts::add(FrameStatus status) {
+    switch (status) {
+    case FrameStatus::OK:           ++good; break;
+    case FrameStatus::TOO_SHORT:    ++too_short; break;
+    case FrameStatus::CRC_MISMATCH: ++crc_errors; break;
+    case FrameStatus::TOO_LONG:     ++too_long; break;
+    case FrameStatus::ABORTED:      ++aborted; break;
+    }
+}
+
+Deframer::Deframer(BitBuffer& out, CrcVariant crc)
+    : out_(out),
+      crc_(crc),
+      crc_lag_(8 + crc_.width()),
+      committed_(out.size()),
+      kept_(out.size()),
+      raw_pos_(0),
+      min_open_(0),
+      state_(START),
+      frame_(),
+      open_(false),
+      max_frame_(0)
+{
+}
+
+void Deframer::push(const BitSpan& bits) {
+    size_t full = bits.size() / 64;
+    for (size_t k = 0; k < full; ++k) step_bits(bits.word(k), 64);
+    unsigned rest = bits.size() & 63;
+    if (rest) step_bits(bits.word(full), rest);
+    if (open_) {
+        feed_lagging();
+        check_length();
+    }
+    verify_pending();
+}
+
+void Deframer::finish() {
+    open_ = false;
+    verify_pending();
+}
+
+// Process the top `nbits` bits of `w`
+void Deframer::step_bits(uint64_t w, unsigned nbits) {
+    // A word without five 1s in a row, entered with a short run, can neither
+    // complete a flag nor contain a stuffed 0 or an abort: it passes through
+    // unchanged
+    if (nbits == 64 && state_ < S(5, 0) && five_ones(w) == 0
+        && state_ / 2 + leading_ones(w) < 5) {
+        state_ = S(trailing_ones(w), 0);
+        raw_pos_ += 64;
+        if (open_) {
+            out_.append(w, 64);
+            feed_lagging();
+            check_length();
+        }
+        return;
+    }
+
+    unsigned i = 0;
+    for (; i + 8 <= nbits; i += 8) {
+        unsigned byte = (w >> (56 - i)) & 0xFF;
+        const Entry& e = table.e[state_][byte];
+        if (!e.flag && !(e.abort && open_)) {
+            if (open_) out_.append(e.bits, e.len);
+            state_ = e.next;
+            raw_pos_ += 8;
+            continue;
+        }
+        for (int j = 7; j >= 0; --j) {
+            unsigned b = (byte >> j) & 1;
+            Step r = step(state_, b);
+            if (r.emit && open_) out_.push_back(b != 0);
+            state_ = r.next;
+            if (r.flag) on_flag(r.zdrop);
+            if (r.abort && open_) on_abort(r.zdrop);
+            ++raw_pos_;
+        }
+    }
+    for (; i < nbits; ++i) {
+        unsigned b = (w >> (63 - i)) & 1;
+        Step r = step(state_, b);
+        if (r.emit && open_) out_.push_back(b != 0);
+        state_ = r.next;
+        if (r.flag) on_flag(r.zdrop);
+        if (r.abort && open_) on_abort(r.zdrop);
+        ++raw_pos_;
+    }
+}
+
+// A flag has just been completed by the bit at raw_pos_
+void Deframer::on_flag(bool zero_dropped) {
+    size_t flag = raw_pos_ - 7;
+    if (!open_) {
+        if (flag >= min_open_) open(flag);
+        return;
+    }
+    // The flag's own bits are already in out_; the frame ended before them.
+    // One starting inside the opening flag leaves no content behind.
+    if (flag >= frame_.flag + 8) close(out_.size() - 8 + (zero_dropped ? 1 : 0));
+    out_.truncate(kept_);
+    open(flag);
+}
+
+void Deframer::open(size_t flag) {
+    frame_ = Frame{flag, out_.size(), out_.size(), crc_.start()};
+    open_ = true;
+}
+
+// Close the open frame, whose content is out_[start, end). Its CRC is
+// checked later, with those of the frames around it; the received CRC is
+// taken off now, so a run of good frames already lies back to back.
+void Deframer::close(size_t end) {
+    open_ = false;
+    if (end == frame_.start) return;        // flag after flag: idle fill
+    unsigned w = crc_.width();
+    Pending p = {frame_.start, frame_.start, frame_.crc_pos, frame_.crc, 0, FrameStatus::OK};
+    if (max_frame_ && end - frame_.start > max_frame_) {
+        p.status = FrameStatus::TOO_LONG;
+    } else if (end - frame_.start < w) {
+        p.status = FrameStatus::TOO_SHORT;
+    } else {
+        p.end  = end - w;
+        p.recv = out_.span().bits(p.end, w);
+        kept_  = p.end;
+    }
+    pending_.push_back(p);
+    if (pending_.size() >= CRC_LANES || kept_ - committed_ >= VERIFY_BITS) verify_pending();
+}
+
+// Decide the pending frames in stream order. Their CRCs are computed
+// together (FrameCrc::update_many), then each good payload is moved down
+// over any bad frames before it and committed before on_frame hears of it.
+// The open frame's content, if any, follows the last payload.
+void Deframer::verify_pending() {
+    if (!pending_.empty()) {
+        regs_.clear();
+        spans_.clear();
+        for (const Pending& p : pending_)
+            if (p.status == FrameStatus::OK) {
+                regs_.push_back(p.crc);
+                spans_.push_back(out_.span(p.crc_pos, p.end - p.crc_pos));
+            }
+        crc_.update_many(regs_.data(), spans_.data(), regs_.size());
+
+        size_t next = 0;
+        for (const Pending& p : pending_) {
+            FrameStatus status = p.status;
+            if (status == FrameStatus::OK && crc_.finish(regs_[next++]) != p.recv)
+                status = FrameStatus::CRC_MISMATCH;
+            if (status == FrameStatus::OK) {
+                size_t len = p.end - p.start;
+                if (p.start != committed_) out_.move_down(committed_, p.start, len);
+                committed_ += len;
+            }
+            report(status);
+        }
+        pending_.clear();
+    }
+
+    size_t size = committed_;
+    if (open_) {
+        size_t shift = frame_.start - committed_;
+        size = out_.size() - shift;
+        if (shift) {
+            out_.move_down(committed_, frame_.start, size - committed_);
+            frame_.start   -= shift;
+            frame_.crc_pos -= shift;
+        }
+    }
+    out_.truncate(size);
+    kept_ = committed_;
+}
+
+// Seven 1s in a row end the open frame. Its content stops before the 0 that
+// starts them; if that was already past the limit, check_length() at any
+// earlier point would have found the frame too long.
+void Deframer::on_abort(bool zero_dropped) {
+    size_t run = 7 + (zero_dropped ? 0 : 1);
+    bool too_long = max_frame_ && out_.size() > frame_.start + run + max_frame_;
+    drop(too_long ? FrameStatus::TOO_LONG : FrameStatus::ABORTED);
+}
+
+// Give up on the open frame; the next flag opens a new one
+void Deframer::drop(FrameStatus status) {
+    open_ = false;
+    verify_pending();
+    report(status);
+    min_open_ = raw_pos_;
+}
+
+void Deframer::report(FrameStatus status) {
+    if (on_frame) on_frame(status, counts_.good);
+    counts_.add(status);
+}
+
+void Deframer::feed_crc(size_t upto) {
+    if (upto <= frame_.crc_pos) return;
+    frame_.crc = crc_.update(frame_.crc, out_.span(frame_.crc_pos, upto - frame_.crc_pos));
+    frame_.crc_pos = upto;
+}
+
+// Keep the CRC of the open frame running a fixed distance behind the output.
+// Intermediate updates stay on whole bytes of content, as FrameCrc needs.
+void Deframer::feed_lagging() {
+    size_t size = out_.size();
+    if (size >= frame_.crc_pos + crc_lag_ + CRC_BATCH) {
+        size_t upto = size - crc_lag_;
+        feed_crc(upto - (upto - frame_.crc_pos) % 8);
+    }
+}
+
+void Deframer::discard_committed() {
+    if (committed_ == 0) return;
+    scratch_.clear();
+    scratch_.append(out_.span(committed_, out_.size() - committed_));
+    out_.clear();
+    out_.append(scratch_);
+    if (open_) {
+        frame_.start   -= committed_;
+        frame_.crc_pos -= committed_;
+    }
+    kept_ -= committed_;
+    committed_ = 0;
+}
+
+// Abandon the frame in progress once it outgrows the configured limit. The
+// last 0 and the 1s after it may yet turn out to be the closing flag, so
+// they do not count; a frame that ends just past the limit is caught by
+// close(). Either way the outcome does not depend on where push() calls cut
+// the stream.
+void Deframer::check_length() {
+    if (max_frame_ == 0) return;
+    size_t flag_bits = 0, flag_out = 0;     // of the flag maybe under way: raw, and in out_
+    if (state_ < B(0)) {
+        flag_bits = state_ / 2 + 1;
+        flag_out  = flag_bits - (state_ & 1);
+    }
+    if (out_.size() <= frame_.start + flag_out + max_frame_) return;
+    drop(FrameStatus::TOO_LONG);
+    min_open_ = raw_pos_ - flag_bits;       // that flag may still open the next frame
+}
@@ -0,0 +1,131 @@
+// deframer.h
+#ifndef DEFRAMER_H
+#define DEFRAMER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "bitbuffer.h"
+#include "crc.h"
+
+enum class FrameStatus {
+    OK,
+    TOO_SHORT,
+    CRC_MISMATCH,
+    TOO_LONG,       // exceeded the streaming frame limit and was dropped
+    ABORTED         // seven or more 1s in a row inside the frame
+};
+
+// Frame decisions so far, by outcome
+struct FrameCounts {
+    size_t good;
+    size_t crc_errors;
+    size_t too_short;
+    size_t too_long;
+    size_t aborted;
+
+    FrameCounts() : good(0), crc_errors(0), too_short(0), too_long(0), aborted(0) {}
+
+    void add(FrameStatus status);
+    size_t bad() const { return crc_errors + too_short + too_long + aborted; }
+};
+
+// Single-pass HDLC deframer. Flag detection, destuffing and CRC
+// accumulation are driven by one (state, input byte) table; destuffed bits
+// go straight into the caller's output buffer and are truncated again if
+// the frame turns out to be bad, so no per-frame buffers are built.
+//
+// Every flag closes the frame before it and opens the next one, whatever
+// the outcome, so no input bit is looked at twice and a corrupted stream
+// decodes in the same linear time as a clean one. Two flags in a row are
+// idle fill, not an empty frame; a flag sharing its leading 0 with the
+// opening one (0111111011111110) takes over from it. A run of seven 1s
+// aborts the frame and the search resumes at the next flag.
+//
+// Closed frames wait a little for their CRC check, so that the CRCs of
+// several short frames are finished together (FrameCrc::update_many);
+// every frame closed by a push() is decided before it returns.
+class Deframer {
+public:
+    explicit Deframer(BitBuffer& out, CrcVariant crc = CrcVariant::CRC16_CCITT);
+
+    // Called once per frame decision, in stream order. `good_frames` is the
+    // number of good frames decoded before this one. A good frame's payload
+    // is by then the end of the committed output.
+    std::function<void(FrameStatus status, size_t good_frames)> on_frame;
+
+    // Feed the next piece of the coded stream
+    void push(const BitSpan& bits);
+
+    // End of stream: drop any frame still waiting for its closing flag
+    void finish();
+
+    size_t frames() const { return counts_.good; }
+    const FrameCounts& counts() const { return counts_; }
+
+    // Output bits [0, committed()) belong to good frames and are final
+    size_t committed() const { return committed_; }
+
+    // Remove the committed prefix from the output buffer, keeping only the
+    // frame still in progress. Lets a streaming caller write out and forget
+    // decoded data so memory stays bounded.
+    void discard_committed();
+
+    // Give up on a frame once its destuffed content exceeds `bits` (0, the
+    // default, means no limit). The frame is reported as TOO_LONG and the
+    // search restarts at the next flag.
+    void set_max_frame(size_t bits) { max_frame_ = bits; }
+
+private:
+    // The open frame; its content starts at out position `start`
+    struct Frame {
+        size_t   flag;      // raw stream position of the opening flag
+        size_t   start;
+        size_t   crc_pos;   // content bits before this are already in `crc`
+        uint64_t crc;
+    };
+
+    // A closed frame waiting for verify_pending(): payload out_[start, end),
+    // CRC fed up to crc_pos, received CRC already taken off the end.
+    // TOO_SHORT ones keep no content.
+    struct Pending {
+        size_t      start;
+        size_t      end;
+        size_t      crc_pos;
+        uint64_t    crc;
+        uint64_t    recv;
+        FrameStatus status;
+    };
+
+    BitBuffer& out_;
+    FrameCrc   crc_;
+    size_t     crc_lag_;    // content bits that may still turn out to be flag or CRC
+    size_t     committed_;  // out_ size after the last good frame
+    size_t     kept_;       // end of the pending frames' content
+    size_t     raw_pos_;    // raw bits consumed so far
+    size_t     min_open_;   // flags before this cannot open a frame
+    unsigned   state_;
+    FrameCounts counts_;
+    Frame      frame_;
+    bool       open_;       // frame_ is in progress
+    size_t     max_frame_;
+    BitBuffer  scratch_;
+    std::vector<Pending>  pending_;
+    std::vector<uint64_t> regs_;        // verify_pending() batch
+    std::vector<BitSpan>  spans_;
+
+    void step_bits(uint64_t w, unsigned nbits);
+    void on_flag(bool zero_dropped);
+    void on_abort(bool zero_dropped);
+    void open(size_t flag);
+    void close(size_t end);
+    void drop(FrameStatus status);
+    void verify_pending();
+    void report(FrameStatus status);
+    void feed_crc(size_t upto);
+    void feed_lagging();
+    void check_length();
+};
+
+#endif // DEFRAMER_H
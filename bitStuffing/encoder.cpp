@@ -0,0 +1,130 @@
+// encoder.cpp
+#include "encoder.h"
+#include <algorithm>
+#include "parallel_crc.h"
+#include "stuffing.h"
+
+namespace {
+
+// Payloads from this size on take the chunked path of encode_frame(),
+// where the CRC runs on the fastest engine for the CPU
+const size_t FUSED_MAX_BITS = 4096;
+
+// Chunk of a long payload put through the CRC and then the stuffer while
+// it is still in L1
+const size_t CHUNK_BITS = 4096;
+
+// FLAG + stuffed(payload + CRC) + FLAG in one pass over the payload: each
+// word goes through the CRC tables and the stuffer while it is in a
+// register. The tail of the payload and the CRC are stuffed together.
+template <class Spec>
+void encode_fused(const BitSpan& payload, BitBuffer& out) {
+    typedef CrcEngine<Spec> Engine;
+    const unsigned w = Spec::width();
+    typename Engine::value_type reg = Engine::start();
+    StuffState st;
+    out.append(FLAG, FLAG_BITS);
+    size_t full = payload.size() / 64;
+    for (size_t k = 0; k < full; ++k) {
+        uint64_t word = payload.word(k);
+        reg = Engine::step_word(reg, word);
+        bit_stuff_word(word, out, st);
+    }
+    unsigned rest = payload.size() & 63;
+    uint64_t tail[2] = {0, 0};
+    if (rest) {
+        tail[0] = payload.word(full) & ~(~uint64_t(0) >> rest);
+        reg = Engine::update_tables(reg, BitSpan(tail, 0, rest));
+    }
+    // The CRC lands right after the tail bits, possibly across both words
+    uint64_t crc = uint64_t(Engine::finish(reg)) << (64 - w);
+    tail[0] |= crc >> rest;
+    if (rest) tail[1] = crc << (64 - rest);
+    bit_stuff(BitSpan(tail, 0, rest + w), out, st);
+    out.append(FLAG, FLAG_BITS);
+}
+
+} // namespace
+
+FrameEncoder::FrameEncoder(size_t payload_bits, CrcVariant crc)
+    : payload_bits_(payload_bits),
+      crc_(crc),
+      pool_(nullptr),
+      frames_(0),
+      bits_out_(0),
+      index_(nullptr),
+      stride_(0),
+      first_frame_(0)
+{
+    partial_.reserve(payload_bits);
+    switch (crc_.variant()) {
+    case CrcVariant::CRC32:  fused_ = encode_fused<Crc32>; break;
+    case CrcVariant::CRC32C: fused_ = encode_fused<Crc32c>; break;
+    default:                 fused_ = encode_fused<Crc16Framing>; break;
+    }
+}
+
+void FrameEncoder::push(const BitSpan& raw, BitBuffer& out) {
+    size_t offset = 0;
+    if (!partial_.empty()) {
+        size_t need = payload_bits_ - partial_.size();
+        if (raw.size() < need) {
+            partial_.append(raw);
+            return;
+        }
+        partial_.append(raw.subspan(0, need));
+        encode_frame(partial_, out);
+        partial_.clear();
+        offset = need;
+    }
+    for (; raw.size() - offset >= payload_bits_; offset += payload_bits_)
+        encode_frame(raw.subspan(offset, payload_bits_), out);
+    partial_.append(raw.subspan(offset));
+}
+
+void FrameEncoder::finish(BitBuffer& out) {
+    if (!partial_.empty()) encode_frame(partial_, out);
+    partial_.clear();
+}
+
+size_t FrameEncoder::output_bound(size_t raw_bits) const {
+    size_t bits = partial_.size() + raw_bits;
+    size_t frames = (bits + payload_bits_ - 1) / payload_bits_;
+    size_t content = bits + frames * crc_.width();
+    // At most one stuffed 0 per five content bits
+    return content + content / 5 + frames * 2 * FLAG_BITS;
+}
+
+// Stuffs the payload and CRC straight into `out`; nothing is copied or
+// allocated on the way, and the payload is read from memory once
+void FrameEncoder::encode_frame(const BitSpan& payload, BitBuffer& out) {
+    if (index_ && stride_ && (first_frame_ + frames_) % stride_ == 0) index_->push_back(bits_out_);
+
+    size_t before = out.size();
+    if (payload.size() < FUSED_MAX_BITS) {
+        fused_(payload, out);
+    } else if (pool_ && payload.size() >= PARALLEL_CRC_BITS) {
+        // The slices are checksummed on the pool before stuffing starts
+        uint64_t crc_word = parallel_crc_compute(*pool_, crc_, payload) << (64 - crc_.width());
+        StuffState st;
+        out.append(FLAG, FLAG_BITS);
+        bit_stuff(payload, out, st);
+        bit_stuff(BitSpan(&crc_word, 0, crc_.width()), out, st);
+        out.append(FLAG, FLAG_BITS);
+    } else {
+        uint64_t reg = crc_.start();
+        StuffState st;
+        out.append(FLAG, FLAG_BITS);
+        for (size_t at = 0; at < payload.size(); at += CHUNK_BITS) {
+            BitSpan chunk = payload.subspan(at, std::min(CHUNK_BITS, payload.size() - at));
+            reg = crc_.update(reg, chunk);
+            bit_stuff(chunk, out, st);
+        }
+        uint64_t crc_word = crc_.finish(reg) << (64 - crc_.width());
+        bit_stuff(BitSpan(&crc_word, 0, crc_.width()), out, st);
+        out.append(FLAG, FLAG_BITS);
+    }
+
+    bits_out_ += out.size() - before;
+    ++frames_;
+}
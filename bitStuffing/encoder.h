@@ -0,0 +1,72 @@
+// encoder.h
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bitbuffer.h"
+#include "crc.h"
+
+class ThreadPool;
+
+// HDLC flag sequence: 0x7E = 01111110
+const uint64_t FLAG = 0x7E;
+const unsigned FLAG_BITS = 8;
+
+// Default payload size of one frame, in bits
+const size_t FRAME_PAYLOAD_BITS = 80;
+
+// Cuts a raw bit stream into fixed-size payloads and appends each one to
+// `out` as FLAG + stuffed(payload + CRC) + FLAG, stuffing straight from the
+// input. Input can arrive in pieces of any size; a payload split across
+// pieces is carried over.
+class FrameEncoder {
+public:
+    explicit FrameEncoder(size_t payload_bits = FRAME_PAYLOAD_BITS,
+                          CrcVariant crc = CrcVariant::CRC16_CCITT);
+
+    // Encode every complete payload available so far
+    void push(const BitSpan& raw, BitBuffer& out);
+
+    // End of stream: encode what is left as a final, shorter frame
+    void finish(BitBuffer& out);
+
+    size_t frames() const { return frames_; }
+
+    // Compute the CRC of payloads of PARALLEL_CRC_BITS or more in slices on
+    // `pool` (parallel_crc.h); null, the default, keeps it on this thread
+    void set_pool(ThreadPool* pool) { pool_ = pool; }
+
+    // Upper bound on the output of pushing `raw_bits` more bits and then
+    // finishing, cheap enough to reserve by. Reserving it keeps push() and
+    // finish() free of allocations.
+    size_t output_bound(size_t raw_bits) const;
+
+    // Record into `index` the output bit offset of frames 0, stride,
+    // 2*stride, ... Offsets count every bit this encoder has produced, so
+    // they stay valid when the caller empties `out` between pushes. When
+    // this encoder handles a later part of a stream, `first_frame` is the
+    // stream-wide number of its first frame.
+    void set_index(std::vector<uint64_t>* index, size_t stride, size_t first_frame = 0) {
+        index_ = index;
+        stride_ = stride;
+        first_frame_ = first_frame;
+    }
+
+private:
+    size_t    payload_bits_;
+    FrameCrc  crc_;
+    ThreadPool* pool_;
+    size_t    frames_;
+    uint64_t  bits_out_;
+    std::vector<uint64_t>* index_;
+    size_t    stride_;
+    size_t    first_frame_;
+    BitBuffer partial_;     // start of a payload whose end has not arrived yet
+    void (*fused_)(const BitSpan&, BitBuffer&);     // single-pass kernel for the CRC
+
+    void encode_frame(const BitSpan& payload, BitBuffer& out);
+};
+
+#endif // ENCODER_H
@@ -0,0 +1,113 @@
+// hdlc.cpp
+#include "hdlc.h"
+#include <algorithm>
+#include <cstring>
+#include "parallel_decoder.h"
+#include "parallel_encoder.h"
+#include "threadpool.h"
+
+namespace {
+
+// Coded bits handled per step by the one-shot calls, so their own buffers
+// stay small whatever the input size
+const size_t STEP_BITS = size_t(1) << 20;
+
+} // namespace
+
+size_t hdlc_encode(const BitSpan& in, const HdlcSink& out, const HdlcOptions& opt) {
+    if (opt.payload_bits == 0) return 0;
+    if (opt.threads != 1) {
+        ThreadPool pool(opt.threads);
+        ParallelFrameEncoder enc(pool, out, opt.payload_bits, opt.crc);
+        enc.push(in);
+        enc.finish();
+        return enc.frames();
+    }
+
+    FrameEncoder enc(opt.payload_bits, opt.crc);
+    size_t step = std::max<size_t>(STEP_BITS / opt.payload_bits, 1) * opt.payload_bits;
+    BitBuffer coded;
+    coded.reserve(enc.output_bound(std::min(step, in.size())));
+    for (size_t pos = 0; pos < in.size(); pos += step) {
+        enc.push(in.subspan(pos, std::min(step, in.size() - pos)), coded);
+        out(coded);
+        coded.clear();
+    }
+    enc.finish(coded);
+    if (!coded.empty()) out(coded);
+    return enc.frames();
+}
+
+FrameCounts hdlc_decode(const BitSpan& in, const HdlcFrameHandler& on_frame,
+                        const HdlcOptions& opt) {
+    if (opt.threads != 1) {
+        ThreadPool pool(opt.threads);
+        BitBuffer out;
+        size_t reported = 0;
+        return parallel_deframe(pool, in, out, [&](FrameStatus status, size_t) {
+            BitSpan payload;
+            if (status == FrameStatus::OK) payload = out.span(reported, out.size() - reported);
+            reported = out.size();
+            if (on_frame) on_frame(status, payload);
+        }, opt.crc);
+    }
+
+    HdlcDecoder dec(on_frame, opt);
+    for (size_t pos = 0; pos < in.size(); pos += STEP_BITS)
+        dec.push(in.subspan(pos, std::min(STEP_BITS, in.size() - pos)));
+    dec.finish();
+    return dec.counts();
+}
+
+HdlcDecoder::HdlcDecoder(HdlcFrameHandler on_frame, const HdlcOptions& opt)
+    : deframer_(out_, opt.crc),
+      on_frame_(on_frame),
+      reported_(0)
+{
+    deframer_.set_max_frame(opt.max_frame);
+    deframer_.on_frame = [this](FrameStatus status, size_t) {
+        BitSpan payload;
+        if (status == FrameStatus::OK) {
+            payload = out_.span(reported_, deframer_.committed() - reported_);
+            reported_ = deframer_.committed();
+        }
+        if (on_frame_) on_frame_(status, payload);
+    };
+}
+
+void HdlcDecoder::push(const BitSpan& coded) {
+    deframer_.push(coded);
+    deframer_.discard_committed();
+    reported_ = 0;
+}
+
+void HdlcDecoder::finish() {
+    deframer_.finish();
+}
+
+BitBuffer hdlc_bits_from_bytes(const uint8_t* data, size_t nbits) {
+    BitBuffer bits;
+    bits.reserve(nbits);
+    size_t i = 0;
+    for (; (i + 8) * 8 <= nbits; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, data + i, 8);
+        bits.append(__builtin_bswap64(w), 64);
+    }
+    for (; (i + 1) * 8 <= nbits; ++i) bits.append(data[i], 8);
+    unsigned rest = nbits % 8;
+    if (rest) bits.append(data[i] >> (8 - rest), rest);
+    return bits;
+}
+
+void hdlc_bytes_from_bits(const BitSpan& bits, uint8_t* data) {
+    size_t nbytes = (bits.size() + 7) / 8;
+    size_t full = nbytes / 8;
+    for (size_t k = 0; k < full; ++k) {
+        uint64_t w = __builtin_bswap64(bits.word(k));
+        std::memcpy(data + 8 * k, &w, 8);
+    }
+    if (full * 8 == nbytes) return;
+    uint64_t w = bits.word(full);
+    for (size_t i = full * 8; i < nbytes; ++i) data[i] = static_cast<uint8_t>(w >> (56 - 8 * (i % 8)));
+}
@@ -0,0 +1,72 @@
+// hdlc.h
+#ifndef HDLC_H
+#define HDLC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "bitbuffer.h"
+#include "crc.h"
+#include "deframer.h"
+#include "encoder.h"
+
+// In-memory interface of libhdlc, the framing code behind bitcrc_encode and
+// bitcrc_decode. Nothing here touches files: streams come in and go out as
+// bit spans, in the MSB-first layout of bitbuffer.h.
+
+struct HdlcOptions {
+    size_t     payload_bits;    // encoder: payload bits per frame
+    CrcVariant crc;
+    unsigned   threads;         // 1: the calling thread only, 0: one per core
+    size_t     max_frame;       // HdlcDecoder: longest frame kept, 0 for no limit
+
+    HdlcOptions() : payload_bits(FRAME_PAYLOAD_BITS), crc(CrcVariant::CRC16_CCITT),
+                    threads(1), max_frame(0) {}
+};
+
+// Receives coded output, in stream order and in pieces of any size. The span
+// is only valid during the call.
+typedef std::function<void(const BitSpan& coded)> HdlcSink;
+
+// Receives each frame decision in stream order; `payload` is the decoded
+// frame for FrameStatus::OK and empty otherwise, valid during the call only
+typedef std::function<void(FrameStatus status, const BitSpan& payload)> HdlcFrameHandler;
+
+// Frame all of `in`; returns the number of frames
+size_t hdlc_encode(const BitSpan& in, const HdlcSink& out,
+                   const HdlcOptions& opt = HdlcOptions());
+
+// Decode a complete coded stream
+FrameCounts hdlc_decode(const BitSpan& in, const HdlcFrameHandler& on_frame,
+                        const HdlcOptions& opt = HdlcOptions());
+
+// Decoder for a stream that arrives in pieces. Frames are handed to the
+// handler during the push() that brings their closing flag; only the frame
+// in progress is kept in memory.
+class HdlcDecoder {
+public:
+    explicit HdlcDecoder(HdlcFrameHandler on_frame, const HdlcOptions& opt = HdlcOptions());
+
+    HdlcDecoder(const HdlcDecoder&) = delete;
+    HdlcDecoder& operator=(const HdlcDecoder&) = delete;
+
+    void push(const BitSpan& coded);
+
+    // End of stream: a frame still waiting for its closing flag is dropped
+    void finish();
+
+    const FrameCounts& counts() const { return deframer_.counts(); }
+
+private:
+    BitBuffer        out_;
+    Deframer         deframer_;
+    HdlcFrameHandler on_frame_;
+    size_t           reported_;     // out_ bits already handed to on_frame_
+};
+
+// Conversions for callers holding bytes: bit i of the stream is bit
+// 7 - i % 8 of byte i / 8
+BitBuffer hdlc_bits_from_bytes(const uint8_t* data, size_t nbits);
+void hdlc_bytes_from_bits(const BitSpan& bits, uint8_t* data);     // (size + 7) / 8 bytes
+
+#endif // HDLC_H
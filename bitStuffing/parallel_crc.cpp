@@ -0,0 +1,40 @@
+// parallel_crc.cpp
+#include "parallel_crc.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+uint64_t parallel_crc_update(ThreadPool& pool, const FrameCrc& crc, uint64_t reg,
+                             const BitSpan& bits) {
+    // Whole words per slice keep every slice but the last byte-aligned,
+    // as reflected CRCs need
+    size_t slice = std::max(PARALLEL_CRC_SLICE_BITS, bits.size() / pool.size());
+    slice = (slice + 63) / 64 * 64;
+    size_t nslices = (bits.size() + slice - 1) / slice;
+    if (nslices <= 1) return crc.update(reg, bits);
+
+    // Slice 0 continues `reg` on this thread; the others start from 0
+    std::vector<uint64_t> regs(nslices);
+    std::atomic<size_t> left(nslices - 1);
+    for (size_t k = 1; k < nslices; ++k)
+        pool.submit([&crc, &bits, &regs, &left, slice, k]() {
+            size_t from = k * slice;
+            regs[k] = crc.update(0, bits.subspan(from, std::min(slice, bits.size() - from)));
+            left.fetch_sub(1);
+        });
+    reg = crc.update(reg, bits.subspan(0, slice));
+    while (left.load() > 0)
+        if (!pool.run_one()) std::this_thread::yield();
+
+    for (size_t k = 1; k < nslices; ++k) {
+        size_t len = std::min(slice, bits.size() - k * slice);
+        reg = crc.shift(reg, len) ^ regs[k];
+    }
+    return reg;
+}
+
+uint64_t parallel_crc_compute(ThreadPool& pool, const FrameCrc& crc, const BitSpan& bits) {
+    if (bits.size() < PARALLEL_CRC_BITS) return crc.compute(bits);
+    return crc.finish(parallel_crc_update(pool, crc, crc.start(), bits));
+}
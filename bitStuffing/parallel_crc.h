@@ -0,0 +1,29 @@
+// parallel_crc.h
+#ifndef PARALLEL_CRC_H
+#define PARALLEL_CRC_H
+
+#include <cstddef>
+#include <cstdint>
+#include "bitbuffer.h"
+#include "crc.h"
+#include "threadpool.h"
+
+// Frames with at least this many bits of CRC input have it computed in
+// slices on the pool; below it one thread is as fast
+const size_t PARALLEL_CRC_BITS = size_t(1) << 23;
+
+// Smallest slice handed to a task, in bits
+const size_t PARALLEL_CRC_SLICE_BITS = size_t(1) << 22;
+
+// FrameCrc::update() over the pool: `bits` is cut into byte-aligned slices,
+// each slice is fed from a zero register by its own task and the results
+// are joined with FrameCrc::shift(). Equal to crc.update(reg, bits). May be
+// called from a task of the same pool; the caller runs queued tasks while
+// it waits.
+uint64_t parallel_crc_update(ThreadPool& pool, const FrameCrc& crc, uint64_t reg,
+                             const BitSpan& bits);
+
+// crc.compute(bits), in slices once `bits` reaches PARALLEL_CRC_BITS
+uint64_t parallel_crc_compute(ThreadPool& pool, const FrameCrc& crc, const BitSpan& bits);
+
+#endif // PARALLEL_CRC_H
@@ -0,0 +1,238 @@
+// parallel_decoder.cpp
+#include "parallel_decoder.h"
+#include <algorithm>
+#include <vector>
+#include "parallel_crc.h"
+#include "stuffing.h"
+
+namespace {
+
+const size_t NO_FLAG = ~size_t(0);
+
+// Smallest region worth a task of its own, in bits
+const size_t MIN_REGION_BITS = size_t(1) << 16;
+
+// Regions per thread, so a slow region does not hold up the others
+const size_t REGIONS_PER_THREAD = 4;
+
+// Destuffed frames are CRC-checked together once there are CRC_LANES of
+// them or their content reaches this many bits
+const size_t BATCH_BITS = 4096;
+
+// Bit (63 - i) is set when 01111110 starts at bit i of `a`; `b` holds the
+// 64 bits that follow `a`
+inline uint64_t flag_starts(uint64_t a, uint64_t b) {
+    uint64_t m = ~a;
+    for (unsigned k = 1; k <= 6; ++k) m &= (a << k) | (b >> (64 - k));
+    return m & ~((a << 7) | (b >> 57));
+}
+
+} // namespace
+
+void scan_flags(const BitSpan& raw, size_t from, size_t to, std::vector<size_t>& flags) {
+    if (raw.size() < 8) return;
+    to = std::min(to, raw.size() - 7);
+    if (from >= to) return;
+    BitSpan s = raw.subspan(from);
+    size_t nwords = (to - from + 63) / 64;
+    uint64_t next = s.word(0);
+    for (size_t k = 0; k < nwords; ++k) {
+        uint64_t cur = next;
+        next = (k + 1) * 64 < s.size() ? s.word(k + 1) : 0;
+        uint64_t m = flag_starts(cur, next);
+        size_t left = to - from - k * 64;
+        if (left < 64) m &= ~low_mask(static_cast<unsigned>(64 - left));
+        while (m) {
+            unsigned i = static_cast<unsigned>(__builtin_clzll(m));
+            flags.push_back(from + k * 64 + i);
+            m &= ~(uint64_t(1) << (63 - i));
+        }
+    }
+}
+
+namespace {
+
+// First flag starting at or after `from`, or NO_FLAG
+size_t next_flag(const BitSpan& raw, size_t from) {
+    std::vector<size_t> found;
+    for (size_t at = from; at < raw.size(); at += MIN_REGION_BITS) {
+        scan_flags(raw, at, at + MIN_REGION_BITS, found);
+        if (!found.empty()) return found.front();
+    }
+    return NO_FLAG;
+}
+
+inline unsigned leading_ones(uint64_t w) {
+    return ~w ? static_cast<unsigned>(__builtin_clzll(~w)) : 64;
+}
+
+inline unsigned trailing_ones(uint64_t w) {
+    return ~w ? static_cast<unsigned>(__builtin_ctzll(~w)) : 64;
+}
+
+// True when `bits` holds seven 1s in a row, which aborts a frame
+bool has_abort(const BitSpan& bits) {
+    unsigned run = 0;       // 1s at the end of the words before
+    for (size_t k = 0; k < bits.word_count(); ++k) {
+        uint64_t w = bits.word(k);
+        if (run + leading_ones(w) >= 7) return true;
+        uint64_t m = w;
+        for (unsigned i = 1; i < 7; ++i) m &= w << i;
+        if (m) return true;
+        run = ~w ? trailing_ones(w) : run + 64;
+    }
+    return false;
+}
+
+// The frame between a flag and the next one
+struct Decision {
+    FrameStatus status;
+    size_t      begin;      // payload within the region output, if OK
+    size_t      len;
+};
+
+struct Region {
+    size_t from, to;
+    std::vector<Decision> frames;
+    BitBuffer out;
+};
+
+// Up to CRC_LANES destuffed frames waiting for their CRC check, each in a
+// buffer of its own that is reused from batch to batch
+struct Batch {
+    BitBuffer content[CRC_LANES];
+    size_t    index[CRC_LANES];     // decision in Region::frames
+    size_t    n;
+
+    Batch() : n(0) {}
+};
+
+// Check the batched frames' CRCs side by side (FrameCrc::update_many) and
+// append the good payloads to the region output, in stream order
+void verify_batch(const FrameCrc& crc, Batch& b, Region& r) {
+    unsigned w = crc.width();
+    uint64_t regs[CRC_LANES];
+    BitSpan  spans[CRC_LANES];
+    for (size_t k = 0; k < b.n; ++k) {
+        regs[k]  = crc.start();
+        spans[k] = b.content[k].span(0, b.content[k].size() - w);
+    }
+    crc.update_many(regs, spans, b.n);
+    for (size_t k = 0; k < b.n; ++k) {
+        Decision& d = r.frames[b.index[k]];
+        if (crc.finish(regs[k]) == b.content[k].span().bits(spans[k].size(), w)) {
+            d.status = FrameStatus::OK;
+            d.begin  = r.out.size();
+            d.len    = spans[k].size();
+            r.out.append(spans[k]);
+        } else {
+            d.status = FrameStatus::CRC_MISMATCH;
+        }
+    }
+    b.n = 0;
+}
+
+void decode_region(ThreadPool& pool, const BitSpan& raw, const FrameCrc& crc, Region& r) {
+    std::vector<size_t> flags;
+    scan_flags(raw, r.from, r.to, flags);
+    if (flags.empty()) return;
+    // The flag closing the region's last frame
+    flags.push_back(next_flag(raw, r.to));
+
+    Batch batch;
+    size_t batch_bits = 0;
+    unsigned w = crc.width();
+    r.frames.reserve(flags.size() - 1);
+    for (size_t i = 0; i + 1 < flags.size(); ++i) {
+        size_t f = flags[i], close = flags[i + 1];
+        if (close <= f + 8) continue;           // shares the flag's 0, or idle fill
+
+        // A frame running into the end of the stream is only reported if
+        // it aborts on the way
+        size_t end = close == NO_FLAG ? raw.size() : close;
+        BitSpan body = raw.subspan(f + 8, end - f - 8);
+        Decision d = {FrameStatus::ABORTED, 0, 0};
+        if (has_abort(body)) {
+            r.frames.push_back(d);
+            continue;
+        }
+        if (close == NO_FLAG) break;
+        d.status = FrameStatus::TOO_SHORT;
+        // The closing flag's leading 0 is never part of the content: either
+        // it is the stuffed 0 after five 1s, or it is the flag's own bit
+        BitBuffer& content = batch.content[batch.n];
+        content.clear();
+        DestuffState st;
+        bit_destuff(body, content, st);
+        size_t len = content.size();
+        if (len < w) {
+            r.frames.push_back(d);
+            continue;
+        }
+        // Frames long enough to split get the pool to themselves
+        if (len - w >= PARALLEL_CRC_BITS) {
+            uint64_t recv = content.span().bits(len - w, w);
+            BitSpan payload = content.span(0, len - w);
+            verify_batch(crc, batch, r);
+            if (parallel_crc_compute(pool, crc, payload) == recv) {
+                d.status = FrameStatus::OK;
+                d.begin  = r.out.size();
+                d.len    = len - w;
+                r.out.append(payload);
+            } else {
+                d.status = FrameStatus::CRC_MISMATCH;
+            }
+            r.frames.push_back(d);
+            batch_bits = 0;
+            continue;
+        }
+        batch.index[batch.n++] = r.frames.size();
+        r.frames.push_back(d);
+        batch_bits += len;
+        if (batch.n == CRC_LANES || batch_bits >= BATCH_BITS) {
+            verify_batch(crc, batch, r);
+            batch_bits = 0;
+        }
+    }
+    verify_batch(crc, batch, r);
+}
+
+} // namespace
+
+FrameCounts parallel_deframe(ThreadPool& pool, const BitSpan& coded, BitBuffer& out,
+                             const std::function<void(FrameStatus, size_t)>& on_frame,
+                             CrcVariant crc_variant) {
+    FrameCrc crc(crc_variant);
+    size_t nregions = std::max<size_t>(1, std::min(pool.size() * REGIONS_PER_THREAD,
+                                                   coded.size() / MIN_REGION_BITS));
+    std::vector<Region> regions(nregions);
+    ReorderBuffer<size_t> done;
+    for (size_t k = 0; k < nregions; ++k) {
+        Region& r = regions[k];
+        r.from = coded.size() * k / nregions;
+        r.to   = coded.size() * (k + 1) / nregions;
+        pool.submit([&pool, &coded, &crc, &r, &done, k]() {
+            decode_region(pool, coded, crc, r);
+            done.put(k, k);
+        });
+    }
+
+    // Every flag closes one frame and opens the next, so the decisions of
+    // the regions only need putting back in order
+    FrameCounts counts;
+    for (size_t k = 0; k < nregions; ++k) {
+        done.take();
+        const Region& r = regions[k];
+        if (!on_frame) {
+            for (const Decision& d : r.frames) counts.add(d.status);
+            out.append(r.out);
+            continue;
+        }
+        for (const Decision& d : r.frames) {
+            if (d.status == FrameStatus::OK) out.append(r.out.span(d.begin, d.len));
+            on_frame(d.status, counts.good);
+            counts.add(d.status);
+        }
+    }
+    return counts;
+}
@@ -0,0 +1,31 @@
+// parallel_decoder.h
+#ifndef PARALLEL_DECODER_H
+#define PARALLEL_DECODER_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include "bitbuffer.h"
+#include "deframer.h"
+#include "threadpool.h"
+
+// Append to `flags` the start of every flag in `raw` that begins in
+// [from, to) and ends within `raw`, 64 positions per step
+void scan_flags(const BitSpan& raw, size_t from, size_t to, std::vector<size_t>& flags);
+
+// Decode a whole coded stream on `pool`, with the same output and the same
+// on_frame calls, in the same order, as Deframer::push() + finish(); here
+// too a good frame's payload ends `out` when on_frame is called.
+//
+// Stuffing keeps 01111110 out of frame contents, so flags can be found
+// anywhere without knowing what came before, and since every flag closes
+// one frame and opens the next, the fate of a frame depends only on the
+// bits between two flags. The stream is cut into regions; each worker
+// finds the flags in its region and decodes the frame after every one of
+// them, reading past the region end for the frame that straddles it. The
+// decisions are then reported and the payloads appended in region order.
+FrameCounts parallel_deframe(ThreadPool& pool, const BitSpan& coded, BitBuffer& out,
+                             const std::function<void(FrameStatus, size_t)>& on_frame,
+                             CrcVariant crc = CrcVariant::CRC16_CCITT);
+
+#endif // PARALLEL_DECODER_H
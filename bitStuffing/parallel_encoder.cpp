@@ -0,0 +1,84 @@
+// parallel_encoder.cpp
+#include "parallel_encoder.h"
+#include <algorithm>
+#include <memory>
+
+ParallelFrameEncoder::ParallelFrameEncoder(ThreadPool& pool, Sink sink,
+                                           size_t payload_bits, CrcVariant crc,
+                                           size_t batch_frames)
+    : pool_(pool),
+      sink_(sink),
+      payload_bits_(payload_bits),
+      crc_(crc),
+      batch_frames_(std::max<size_t>(1, std::min(batch_frames, PARALLEL_BATCH_BITS / payload_bits))),
+      max_inflight_(4 * pool.size()),
+      submitted_(0),
+      frames_(0),
+      bits_out_(0),
+      index_(nullptr),
+      stride_(0)
+{
+}
+
+void ParallelFrameEncoder::push(const BitSpan& raw) {
+    size_t batch_bits = batch_frames_ * payload_bits_;
+    size_t pos = 0;
+    while (pos < raw.size()) {
+        size_t n = std::min(raw.size() - pos, batch_bits - filling_.size());
+        filling_.append(raw.subspan(pos, n));
+        pos += n;
+        if (filling_.size() == batch_bits) submit(false);
+    }
+}
+
+void ParallelFrameEncoder::finish() {
+    if (!filling_.empty()) submit(true);
+    drain(0);
+}
+
+// Hand the filled batch to the pool; only the last one may end in a short frame
+void ParallelFrameEncoder::submit(bool last) {
+    std::shared_ptr<BitBuffer> raw = std::make_shared<BitBuffer>();
+    std::swap(*raw, filling_);
+    size_t seq = submitted_++;
+    size_t first_frame = seq * batch_frames_;
+    size_t payload_bits = payload_bits_;
+    CrcVariant crc = crc_;
+    size_t stride = index_ ? stride_ : 0;
+    ReorderBuffer<Batch>& done = done_;
+    ThreadPool& pool = pool_;
+
+    pool_.submit([=, &done, &pool]() {
+        Batch batch;
+        FrameEncoder encoder(payload_bits, crc);
+        encoder.set_pool(&pool);
+        if (stride) encoder.set_index(&batch.index, stride, first_frame);
+        batch.coded.reserve(encoder.output_bound(raw->size()));
+        encoder.push(*raw, batch.coded);
+        if (last) encoder.finish(batch.coded);
+        batch.frames = encoder.frames();
+        done.put(seq, std::move(batch));
+    });
+
+    drain(max_inflight_);
+}
+
+void ParallelFrameEncoder::emit(Batch& batch) {
+    if (index_)
+        for (size_t i = 0; i < batch.index.size(); ++i)
+            index_->push_back(bits_out_ + batch.index[i]);
+    sink_(batch.coded);
+    bits_out_ += batch.coded.size();
+    frames_ += batch.frames;
+}
+
+// Write out every batch that is ready in order, then keep waiting until no
+// more than `max_waiting` remain unwritten
+void ParallelFrameEncoder::drain(size_t max_waiting) {
+    Batch batch;
+    while (done_.try_take(batch)) emit(batch);
+    while (submitted_ - done_.next() > max_waiting) {
+        batch = done_.take();
+        emit(batch);
+    }
+}
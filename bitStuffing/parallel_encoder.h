@@ -0,0 +1,78 @@
+// parallel_encoder.h
+#ifndef PARALLEL_ENCODER_H
+#define PARALLEL_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "bitbuffer.h"
+#include "encoder.h"
+#include "threadpool.h"
+
+// Frames per batch handed to one task
+const size_t PARALLEL_BATCH_FRAMES = 4096;
+
+// Cap on the raw bits of a batch, which lowers the frame count for large
+// payloads; a batch always holds at least one frame
+const size_t PARALLEL_BATCH_BITS = size_t(1) << 24;
+
+// FrameEncoder spread over a thread pool. Frames do not depend on each
+// other, so the raw stream is cut into batches of whole payloads that are
+// encoded independently; a reorder buffer passes the coded batches to
+// `sink` in stream order, each as soon as all earlier ones are out. The
+// output is bit-for-bit that of FrameEncoder. Large payloads also get
+// their CRC computed in slices on the pool.
+class ParallelFrameEncoder {
+public:
+    // Receives coded output in stream order, on the thread calling push()
+    // or finish()
+    typedef std::function<void(const BitSpan& coded)> Sink;
+
+    ParallelFrameEncoder(ThreadPool& pool, Sink sink,
+                         size_t payload_bits = FRAME_PAYLOAD_BITS,
+                         CrcVariant crc = CrcVariant::CRC16_CCITT,
+                         size_t batch_frames = PARALLEL_BATCH_FRAMES);
+
+    // Queue the raw bits; full batches start encoding right away. Blocks
+    // while too many batches are still waiting to be written.
+    void push(const BitSpan& raw);
+
+    // End of stream: encode the rest and wait for every batch
+    void finish();
+
+    size_t frames() const { return frames_; }
+
+    // As FrameEncoder::set_index(); entries are added as batches reach the sink
+    void set_index(std::vector<uint64_t>* index, size_t stride) {
+        index_ = index;
+        stride_ = stride;
+    }
+
+private:
+    struct Batch {
+        BitBuffer coded;
+        std::vector<uint64_t> index;    // offsets within `coded`
+        size_t frames;
+    };
+
+    ThreadPool& pool_;
+    Sink        sink_;
+    size_t      payload_bits_;
+    CrcVariant  crc_;
+    size_t      batch_frames_;
+    size_t      max_inflight_;
+    BitBuffer   filling_;       // raw bits of the batch not yet submitted
+    size_t      submitted_;
+    size_t      frames_;
+    uint64_t    bits_out_;
+    std::vector<uint64_t>* index_;
+    size_t      stride_;
+    ReorderBuffer<Batch> done_;
+
+    void submit(bool last);
+    void emit(Batch& batch);
+    void drain(size_t max_waiting);
+};
+
+#endif // PARALLEL_ENCODER_H
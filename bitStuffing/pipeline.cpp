@@ -0,0 +1,580 @@
+// pipeline.cpp
+#include "pipeline.h"
+#include "stats.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define PIPELINE_URING 1
+#endif
+#endif
+
+namespace {
+
+// Waiting side of the queues: yield for a while, then sleep. The stages
+// trade whole blocks, so waking up a little late costs next to nothing.
+class Backoff {
+public:
+    Backoff() : n_(0) {}
+
+    void pause() {
+        if (n_ < 64) {
+            ++n_;
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    void reset() { n_ = 0; }
+
+private:
+    unsigned n_;
+};
+
+bool is_regular(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// Bytes read at `at`; short only at the end of the file or on an error
+size_t pread_full(int fd, char* p, size_t n, int64_t at) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = ::pread(fd, p + done, n - done, static_cast<off_t>(at + done));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        done += static_cast<size_t>(r);
+    }
+    return done;
+}
+
+bool pwrite_full(int fd, const char* p, size_t n, int64_t at) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = ::pwrite(fd, p + done, n - done, static_cast<off_t>(at + done));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        done += static_cast<size_t>(r);
+    }
+    return true;
+}
+
+bool write_full(int fd, const char* p, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = ::write(fd, p + done, n - done);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        done += static_cast<size_t>(r);
+    }
+    return true;
+}
+
+// read() on a pipe or terminal that gives up once `stop` is set, so the
+// reader thread can be joined even if nobody ever writes to the pipe
+ssize_t read_until_stopped(int fd, char* p, size_t n, const std::atomic<bool>& stop) {
+    for (;;) {
+        pollfd pfd = {fd, POLLIN, 0};
+        int r = poll(&pfd, 1, 100);
+        if (stop.load()) return 0;
+        if (r == 0 || (r < 0 && errno == EINTR)) continue;
+        ssize_t got;
+        {
+            StatClock busy(Stat::READ_NS);
+            got = ::read(fd, p, n);
+        }
+        if (got < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        return got;
+    }
+}
+
+#ifdef PIPELINE_URING
+// Just enough io_uring for one thread's reads or writes, set up with the
+// raw system calls so there is no liburing to depend on. The vectored
+// opcodes go back to the first kernels that had io_uring.
+class Uring {
+public:
+    explicit Uring(unsigned entries);
+    ~Uring();
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+
+    // Queue one IORING_OP_READV / IORING_OP_WRITEV of `iov` at `offset` and
+    // submit it; `iov` must stay valid until its completion is taken
+    bool submit(uint8_t op, int fd, const iovec* iov, int64_t offset, uint64_t tag);
+
+    // Wait for the next completion: the tag it was submitted with and the
+    // result, bytes done or -errno
+    bool wait(uint64_t& tag, int& res);
+
+private:
+    int      fd_;
+    void*    sq_map_;
+    size_t   sq_len_;
+    void*    cq_map_;
+    size_t   cq_len_;
+    void*    sqe_map_;
+    size_t   sqe_len_;
+    unsigned* sq_tail_;
+    unsigned* sq_mask_;
+    unsigned* sq_array_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned* cq_mask_;
+    io_uring_sqe* sqes_;
+    io_uring_cqe* cqes_;
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd_, to_submit, min_complete,
+                                        flags, nullptr, 0));
+    }
+};
+
+Uring::Uring(unsigned entries)
+    : fd_(-1),
+      sq_map_(MAP_FAILED),
+      sq_len_(0),
+      cq_map_(MAP_FAILED),
+      cq_len_(0),
+      sqe_map_(MAP_FAILED),
+      sqe_len_(0)
+{
+    io_uring_params p;
+    std::memset(&p, 0, sizeof p);
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if (fd < 0) return;
+
+    sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+    sq_map_ = mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd, IORING_OFF_SQ_RING);
+    if (sq_map_ != MAP_FAILED && !single)
+        cq_map_ = mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd, IORING_OFF_CQ_RING);
+    sqe_len_ = p.sq_entries * sizeof(io_uring_sqe);
+    if (sq_map_ != MAP_FAILED)
+        sqe_map_ = mmap(nullptr, sqe_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_SQES);
+    const char* cq = static_cast<const char*>(single ? sq_map_ : cq_map_);
+    if (sq_map_ == MAP_FAILED || cq == MAP_FAILED || sqe_map_ == MAP_FAILED) {
+        ::close(fd);
+        return;
+    }
+
+    char* sq = static_cast<char*>(sq_map_);
+    sq_tail_  = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_  = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    cq_head_  = reinterpret_cast<unsigned*>(const_cast<char*>(cq) + p.cq_off.head);
+    cq_tail_  = reinterpret_cast<unsigned*>(const_cast<char*>(cq) + p.cq_off.tail);
+    cq_mask_  = reinterpret_cast<unsigned*>(const_cast<char*>(cq) + p.cq_off.ring_mask);
+    cqes_     = reinterpret_cast<io_uring_cqe*>(const_cast<char*>(cq) + p.cq_off.cqes);
+    sqes_     = static_cast<io_uring_sqe*>(sqe_map_);
+    fd_ = fd;
+}
+
+Uring::~Uring() {
+    if (sqe_map_ != MAP_FAILED) munmap(sqe_map_, sqe_len_);
+    if (cq_map_ != MAP_FAILED) munmap(cq_map_, cq_len_);
+    if (sq_map_ != MAP_FAILED) munmap(sq_map_, sq_len_);
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool Uring::submit(uint8_t op, int fd, const iovec* iov, int64_t offset, uint64_t tag) {
+    unsigned tail = *sq_tail_;      // only this thread moves it
+    unsigned i = tail & *sq_mask_;
+    io_uring_sqe& e = sqes_[i];
+    std::memset(&e, 0, sizeof e);
+    e.opcode    = op;
+    e.fd        = fd;
+    e.addr      = reinterpret_cast<uint64_t>(iov);
+    e.len       = 1;
+    e.off       = static_cast<uint64_t>(offset);
+    e.user_data = tag;
+    sq_array_[i] = i;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    int r;
+    do {
+        r = enter(1, 0, 0);
+    } while (r < 0 && errno == EINTR);
+    return r == 1;
+}
+
+bool Uring::wait(uint64_t& tag, int& res) {
+    unsigned head = *cq_head_;
+    while (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+        if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) return false;
+    const io_uring_cqe& c = cqes_[head & *cq_mask_];
+    tag = c.user_data;
+    res = c.res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+#endif // PIPELINE_URING
+
+} // namespace
+
+bool pipeline_have_uring() {
+#ifdef PIPELINE_URING
+    static const bool have = Uring(1).ok();
+    return have;
+#else
+    return false;
+#endif
+}
+
+// ---- ReadStage ----
+
+ReadStage::ReadStage(int fd, size_t block_bytes)
+    : fd_(fd),
+      block_bytes_(block_bytes),
+      started_(false),
+      done_(false),
+      stop_(false),
+      full_(PIPELINE_DEPTH + 2),
+      free_(PIPELINE_DEPTH + 2)
+{
+}
+
+ReadStage::~ReadStage() {
+    stop_ = true;
+    if (thread_.joinable()) thread_.join();
+}
+
+bool ReadStage::get(std::vector<char>& block, size_t& len) {
+    len = 0;
+    if (done_) return false;
+    if (!started_) {
+        started_ = true;
+        for (unsigned i = 0; i < PIPELINE_DEPTH; ++i) {
+            IoBlock b;
+            b.data.resize(block_bytes_);
+            free_.try_push(b);
+        }
+        // Pipes cannot seek: -1 tells run() to use read()
+        int64_t at = is_regular(fd_) ? lseek(fd_, 0, SEEK_CUR) : -1;
+        thread_ = std::thread(&ReadStage::run, this, at);
+    }
+
+    IoBlock b;
+    if (!full_.try_pop(b)) {
+        StatClock waited(Stat::WAIT_NS);
+        Backoff wait;
+        while (!full_.try_pop(b)) wait.pause();
+    }
+    if (b.len == 0) {
+        done_ = true;
+        return false;
+    }
+    // The caller's previous block goes back for reading into
+    block.swap(b.data);
+    len = b.len;
+    if (!b.data.empty()) free_.try_push(b);
+    return true;
+}
+
+void ReadStage::run(int64_t offset) {
+    if (offset >= 0 && pipeline_have_uring() && run_uring(offset)) return;
+    IoBlock b;
+    while (take_free(b)) {
+        b.data.resize(block_bytes_);
+        if (offset >= 0) {
+            StatClock busy(Stat::READ_NS);
+            b.len = pread_full(fd_, b.data.data(), block_bytes_, offset);
+            offset += static_cast<int64_t>(b.len);
+        } else {
+            ssize_t n = read_until_stopped(fd_, b.data.data(), block_bytes_, stop_);
+            b.len = n > 0 ? static_cast<size_t>(n) : 0;
+        }
+        // A short pread is the end of the file
+        bool end = b.len == 0 || (offset >= 0 && b.len < block_bytes_);
+        if (b.len > 0) deliver(b);
+        if (end) break;
+    }
+    IoBlock marker;
+    deliver(marker);
+}
+
+#ifdef PIPELINE_URING
+// Up to PIPELINE_DEPTH reads of consecutive blocks are queued at a time.
+// They may complete in any order and are delivered in file order.
+bool ReadStage::run_uring(int64_t offset) {
+    Uring ring(PIPELINE_DEPTH);
+    if (!ring.ok()) return false;
+    struct Slot {
+        IoBlock block;
+        iovec   iov;
+        int64_t at;
+        bool    done;
+    };
+    std::vector<Slot> slots(PIPELINE_DEPTH);
+    uint64_t submitted = 0, delivered = 0;
+    bool end = false;
+    Backoff wait;
+    for (;;) {
+        while (!end && !stop_ && submitted - delivered < PIPELINE_DEPTH) {
+            Slot& s = slots[submitted % PIPELINE_DEPTH];
+            if (!free_.try_pop(s.block)) break;
+            s.block.data.resize(block_bytes_);
+            s.iov.iov_base = s.block.data.data();
+            s.iov.iov_len  = block_bytes_;
+            s.at   = offset;
+            s.done = false;
+            if (!ring.submit(IORING_OP_READV, fd_, &s.iov, offset, submitted)) {
+                end = true;
+                break;
+            }
+            offset += static_cast<int64_t>(block_bytes_);
+            ++submitted;
+        }
+        if (submitted == delivered) {
+            if (end || stop_) break;
+            wait.pause();
+            continue;
+        }
+        wait.reset();
+
+        uint64_t tag;
+        int res;
+        uint64_t t0 = stats_now_ns();
+        if (!ring.wait(tag, res)) break;    // cannot happen with reads in flight
+        Slot& s = slots[tag % PIPELINE_DEPTH];
+        s.block.len = res > 0 ? static_cast<size_t>(res) : 0;
+        // A read cut short is finished by hand; only the end of the file
+        // leaves it short
+        if (res > 0 && s.block.len < block_bytes_)
+            s.block.len += pread_full(fd_, s.block.data.data() + s.block.len,
+                                      block_bytes_ - s.block.len, s.at + res);
+        stats_add(Stat::READ_NS, stats_now_ns() - t0);
+        s.done = true;
+
+        for (; delivered < submitted && slots[delivered % PIPELINE_DEPTH].done; ++delivered) {
+            Slot& d = slots[delivered % PIPELINE_DEPTH];
+            d.done = false;
+            if (end) continue;              // past the end: dropped
+            if (d.block.len < block_bytes_) end = true;
+            if (d.block.len > 0) deliver(d.block);
+        }
+    }
+    IoBlock marker;
+    deliver(marker);
+    return true;
+}
+#else
+bool ReadStage::run_uring(int64_t) {
+    return false;
+}
+#endif
+
+bool ReadStage::take_free(IoBlock& block) {
+    Backoff wait;
+    while (!free_.try_pop(block)) {
+        if (stop_) return false;
+        wait.pause();
+    }
+    return true;
+}
+
+void ReadStage::deliver(IoBlock& block) {
+    stats_add(Stat::BYTES_IN, block.len);
+    Backoff wait;
+    while (!full_.try_push(block)) {
+        if (stop_) return;
+        wait.pause();
+    }
+}
+
+// ---- WriteStage ----
+
+WriteStage::WriteStage(int fd, size_t block_bytes)
+    : fd_(fd),
+      block_bytes_(block_bytes),
+      started_(false),
+      queued_(0),
+      written_(0),
+      failed_(false),
+      stop_(false),
+      full_(PIPELINE_DEPTH + 2),
+      free_(PIPELINE_DEPTH + 2)
+{
+}
+
+WriteStage::~WriteStage() {
+    if (!started_) return;
+    flush();
+    stop_ = true;
+    thread_.join();
+}
+
+bool WriteStage::put(std::vector<char>& block, size_t len) {
+    if (!started_) {
+        started_ = true;
+        // With the caller's block, PIPELINE_DEPTH buffers go round
+        for (unsigned i = 1; i < PIPELINE_DEPTH; ++i) {
+            IoBlock b;
+            b.data.resize(block_bytes_);
+            free_.try_push(b);
+        }
+        // Appending descriptors ignore offsets, and pipes have none: -1
+        // makes run() use write()
+        int64_t at = -1;
+        if (is_regular(fd_) && !(fcntl(fd_, F_GETFL) & O_APPEND)) at = lseek(fd_, 0, SEEK_CUR);
+        thread_ = std::thread(&WriteStage::run, this, at);
+    }
+
+    size_t size = block.size();
+    IoBlock b;
+    b.data.swap(block);
+    b.len = len;
+    uint64_t t0 = stats_now_ns();
+    Backoff wait;
+    while (!full_.try_push(b)) wait.pause();
+    ++queued_;
+
+    // Waits here while the writer is PIPELINE_DEPTH blocks behind
+    wait.reset();
+    while (!free_.try_pop(b)) wait.pause();
+    stats_add(Stat::WAIT_NS, stats_now_ns() - t0);
+    b.data.resize(size);
+    block.swap(b.data);
+    return !failed_.load();
+}
+
+bool WriteStage::flush() {
+    StatClock waited(Stat::WAIT_NS);
+    Backoff wait;
+    while (written_.load() < queued_) wait.pause();
+    return !failed_.load();
+}
+
+void WriteStage::run(int64_t offset) {
+    if (offset >= 0 && pipeline_have_uring() && run_uring(offset)) return;
+    IoBlock b;
+    Backoff wait;
+    for (;;) {
+        if (!full_.try_pop(b)) {
+            if (stop_) return;
+            wait.pause();
+            continue;
+        }
+        wait.reset();
+        if (!failed_.load()) {
+            StatClock busy(Stat::WRITE_NS);
+            bool ok = offset >= 0 ? pwrite_full(fd_, b.data.data(), b.len, offset)
+                                  : write_full(fd_, b.data.data(), b.len);
+            if (ok) stats_add(Stat::BYTES_OUT, b.len);
+            else failed_ = true;
+            if (offset >= 0) {
+                offset += static_cast<int64_t>(b.len);
+                lseek(fd_, offset, SEEK_SET);
+            }
+        }
+        recycle(b);
+    }
+}
+
+#ifdef PIPELINE_URING
+// Up to PIPELINE_DEPTH writes in flight, each at its own offset, so the
+// order they complete in does not matter. The descriptor's position is
+// moved past them whenever none is left in flight.
+bool WriteStage::run_uring(int64_t offset) {
+    Uring ring(PIPELINE_DEPTH);
+    if (!ring.ok()) return false;
+    struct Slot {
+        IoBlock block;
+        iovec   iov;
+        int64_t at;
+        bool    busy;
+    };
+    std::vector<Slot> slots(PIPELINE_DEPTH);
+    unsigned inflight = 0;
+    int64_t placed = offset;        // the descriptor's position
+    IoBlock b;
+    Backoff wait;
+    for (;;) {
+        while (inflight < PIPELINE_DEPTH && full_.try_pop(b)) {
+            if (failed_.load()) {
+                recycle(b);
+                continue;
+            }
+            unsigned k = 0;
+            while (slots[k].busy) ++k;
+            Slot& s = slots[k];
+            s.block = std::move(b);
+            s.iov.iov_base = s.block.data.data();
+            s.iov.iov_len  = s.block.len;
+            s.at   = offset;
+            s.busy = true;
+            offset += static_cast<int64_t>(s.block.len);
+            if (ring.submit(IORING_OP_WRITEV, fd_, &s.iov, s.at, k)) {
+                ++inflight;
+            } else {
+                failed_ = true;
+                s.busy = false;
+                recycle(s.block);
+            }
+        }
+        if (inflight == 0) {
+            if (placed != offset) placed = lseek(fd_, offset, SEEK_SET);
+            if (stop_) return true;
+            wait.pause();
+            continue;
+        }
+        wait.reset();
+
+        uint64_t tag;
+        int res;
+        StatClock busy(Stat::WRITE_NS);
+        if (!ring.wait(tag, res)) {
+            // Hand back the blocks still in flight; run() goes on draining
+            // the rest without writing, so put() and flush() do not wait
+            // for ever
+            failed_ = true;
+            for (Slot& s : slots)
+                if (s.busy) {
+                    s.busy = false;
+                    recycle(s.block);
+                }
+            return false;
+        }
+        Slot& s = slots[tag];
+        size_t done = res > 0 ? static_cast<size_t>(res) : 0;
+        if (res < 0 || (done < s.block.len
+                        && !pwrite_full(fd_, s.block.data.data() + done, s.block.len - done,
+                                        s.at + res)))
+            failed_ = true;
+        else
+            stats_add(Stat::BYTES_OUT, s.block.len);
+        s.busy = false;
+        --inflight;
+        recycle(s.block);
+    }
+}
+#else
+bool WriteStage::run_uring(int64_t) {
+    return false;
+}
+#endif
+
+void WriteStage::recycle(IoBlock& block) {
+    Backoff wait;
+    while (!free_.try_push(block)) wait.pause();
+    written_.fetch_add(1);
+}
@@ -0,0 +1,125 @@
+// pipeline.h
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "bitio.h"
+
+// Blocks in flight per stage: enough for the disk to stay busy while the
+// worker is on another block, few enough to keep memory at a few MB
+const unsigned PIPELINE_DEPTH = 4;
+
+// Bounded single-producer, single-consumer ring; neither side ever takes a
+// lock. One slot stays empty to tell a full ring from an empty one.
+template <class T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : slots_(capacity + 1), head_(0), tail_(0) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer only; moves from `value` on success
+    bool try_push(T& value) {
+        size_t t = tail_.load(std::memory_order_relaxed);
+        size_t next = t + 1 == slots_.size() ? 0 : t + 1;
+        if (next == head_.load(std::memory_order_acquire)) return false;
+        slots_[t] = std::move(value);
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only
+    bool try_pop(T& value) {
+        size_t h = head_.load(std::memory_order_relaxed);
+        if (h == tail_.load(std::memory_order_acquire)) return false;
+        value = std::move(slots_[h]);
+        head_.store(h + 1 == slots_.size() ? 0 : h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> slots_;
+    alignas(64) std::atomic<size_t> head_;     // next slot to pop
+    alignas(64) std::atomic<size_t> tail_;     // next slot to push
+};
+
+// A buffer travelling between stages; `len` bytes of it are data
+struct IoBlock {
+    std::vector<char> data;
+    size_t len;
+
+    IoBlock() : len(0) {}
+};
+
+// Reader stage: a thread reads the descriptor ahead, from its position at
+// the first get(), while the caller works on the block before. Regular
+// files keep PIPELINE_DEPTH reads queued through io_uring where the kernel
+// allows it and use pread() otherwise; pipes and terminals use read().
+class ReadStage : public ByteSource {
+public:
+    explicit ReadStage(int fd, size_t block_bytes = BLOCK_BYTES);
+    ~ReadStage();
+
+    ReadStage(const ReadStage&) = delete;
+    ReadStage& operator=(const ReadStage&) = delete;
+
+    bool get(std::vector<char>& block, size_t& len) override;
+
+private:
+    int    fd_;
+    size_t block_bytes_;
+    bool   started_;
+    bool   done_;                   // the end marker has been taken
+    std::atomic<bool> stop_;
+    SpscQueue<IoBlock> full_;       // reader -> caller; len 0 marks the end
+    SpscQueue<IoBlock> free_;       // caller -> reader
+    std::thread thread_;
+
+    void run(int64_t offset);
+    bool run_uring(int64_t offset);     // false when no ring can be set up
+    bool take_free(IoBlock& block);
+    void deliver(IoBlock& block);
+};
+
+// Writer stage: a thread writes the blocks handed to put() in order, from
+// the descriptor's position at the first put(), while the caller fills the
+// next one. Regular files are written through io_uring or pwrite(), others
+// with write(). The descriptor's position is left after the data.
+class WriteStage : public ByteSink {
+public:
+    explicit WriteStage(int fd, size_t block_bytes = BLOCK_BYTES);
+    ~WriteStage();      // writes what is left
+
+    WriteStage(const WriteStage&) = delete;
+    WriteStage& operator=(const WriteStage&) = delete;
+
+    bool put(std::vector<char>& block, size_t len) override;
+    bool flush() override;
+
+private:
+    int    fd_;
+    size_t block_bytes_;
+    bool   started_;
+    size_t queued_;                 // blocks handed to the thread
+    std::atomic<size_t> written_;   // blocks it is done with
+    std::atomic<bool>   failed_;
+    std::atomic<bool>   stop_;
+    SpscQueue<IoBlock> full_;       // caller -> writer
+    SpscQueue<IoBlock> free_;       // writer -> caller
+    std::thread thread_;
+
+    void run(int64_t offset);
+    bool run_uring(int64_t offset);     // false when no ring can be set up or it fails
+    void recycle(IoBlock& block);
+};
+
+// True when io_uring can be set up in this process; seccomp filters and
+// older kernels refuse it, and the stages then use pread() / pwrite()
+bool pipeline_have_uring();
+
+#endif // PIPELINE_H
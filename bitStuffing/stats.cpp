@@ -0,0 +1,152 @@
+// stats.cpp
+#include "stats.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include <sys/resource.h>
+
+namespace {
+
+const unsigned NSTATS = static_cast<unsigned>(Stat::COUNT);
+
+// One thread's counters. Only the owner writes them; the padding keeps
+// two threads' slots off a shared cache line.
+struct Slot {
+    char pad0[64];
+    std::atomic<uint64_t> v[NSTATS];
+    char pad1[64];
+
+    Slot() {
+        for (auto& c : v) c.store(0, std::memory_order_relaxed);
+    }
+};
+
+// Slots outlive their threads, so a pool that has already shut down still
+// counts; the registry is never freed, as threads may count during exit
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Slot>> slots;
+};
+
+Registry& registry() {
+    static Registry* r = new Registry;
+    return *r;
+}
+
+thread_local Slot* own_slot = nullptr;
+
+Slot& slot() {
+    if (!own_slot) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.slots.emplace_back(new Slot);
+        own_slot = r.slots.back().get();
+    }
+    return *own_slot;
+}
+
+const uint64_t program_start = stats_now_ns();
+
+double seconds(uint64_t ns) { return static_cast<double>(ns) * 1e-9; }
+
+double ratio(uint64_t a, uint64_t b) { return b ? static_cast<double>(a) / static_cast<double>(b) : 0; }
+
+long peak_rss_kb() {
+    struct rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : 0;    // KB on Linux
+}
+
+} // namespace
+
+void stats_add(Stat stat, uint64_t n) {
+    std::atomic<uint64_t>& c = slot().v[static_cast<unsigned>(stat)];
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void stats_set(Stat stat, uint64_t value) {
+    slot().v[static_cast<unsigned>(stat)].store(value, std::memory_order_relaxed);
+}
+
+uint64_t stats_total(Stat stat) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    uint64_t sum = 0;
+    for (const auto& s : r.slots) sum += s->v[static_cast<unsigned>(stat)].load(std::memory_order_relaxed);
+    return sum;
+}
+
+uint64_t stats_now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+double stats_elapsed() {
+    return seconds(stats_now_ns() - program_start);
+}
+
+std::string stats_json(const char* tool) {
+    uint64_t t[NSTATS];
+    for (unsigned i = 0; i < NSTATS; ++i) t[i] = stats_total(static_cast<Stat>(i));
+    auto get = [&](Stat s) { return t[static_cast<unsigned>(s)]; };
+    double wall = stats_elapsed();
+    double code = wall - seconds(get(Stat::WAIT_NS));
+    uint64_t frames = get(Stat::FRAMES), bad = get(Stat::BAD_FRAMES);
+
+    std::ostringstream os;
+    os.precision(6);
+    os << "{\"tool\": \"" << tool << "\", \"wall_s\": " << wall
+       << ", \"stages\": {\"read_s\": " << seconds(get(Stat::READ_NS))
+       << ", \"code_s\": " << (code > 0 ? code : 0)
+       << ", \"write_s\": " << seconds(get(Stat::WRITE_NS)) << "}"
+       << ", \"bytes_in\": " << get(Stat::BYTES_IN) << ", \"bytes_out\": " << get(Stat::BYTES_OUT)
+       << ", \"bits_in\": " << get(Stat::BITS_IN) << ", \"bits_out\": " << get(Stat::BITS_OUT);
+    if (get(Stat::CONTENT_BITS))
+        os << ", \"stuffed_bits\": " << get(Stat::STUFFED_BITS)
+           << ", \"stuffing_overhead\": " << ratio(get(Stat::STUFFED_BITS), get(Stat::CONTENT_BITS));
+    os << ", \"frames\": " << frames << ", \"frames_per_s\": " << ratio(frames, 1) / (wall > 0 ? wall : 1)
+       << ", \"bad_frames\": " << bad << ", \"crc_errors\": " << get(Stat::CRC_ERRORS)
+       << ", \"crc_failure_rate\": " << ratio(get(Stat::CRC_ERRORS), frames + bad)
+       << ", \"peak_rss_kb\": " << peak_rss_kb() << "}";
+    return os.str();
+}
+
+StatsProgress::StatsProgress(const char* tool, double interval)
+    : tool_(tool),
+      interval_(interval),
+      stop_(false)
+{
+    if (interval_ > 0) thread_ = std::thread(&StatsProgress::run, this);
+}
+
+StatsProgress::~StatsProgress() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+void StatsProgress::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto period = std::chrono::duration<double>(interval_);
+    uint64_t last_in = 0;
+    double last_t = stats_elapsed();
+    while (!wake_.wait_for(lock, period, [this] { return stop_; })) {
+        double t = stats_elapsed();
+        uint64_t in = stats_total(Stat::BYTES_IN);
+        char line[256];
+        std::snprintf(line, sizeof line,
+                      "%s: %.1f s, %.1f MB in, %.1f MB out, %llu frames, %.1f MB/s\n",
+                      tool_, t, in / 1e6, stats_total(Stat::BYTES_OUT) / 1e6,
+                      static_cast<unsigned long long>(stats_total(Stat::FRAMES)),
+                      t > last_t ? (in - last_in) / 1e6 / (t - last_t) : 0.0);
+        std::cerr << line;
+        last_in = in;
+        last_t = t;
+    }
+}
@@ -0,0 +1,80 @@
+// stats.h
+#ifndef STATS_H
+#define STATS_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Runtime counters behind --stats and --progress. Every thread adds to a
+// slot of its own with plain relaxed stores, so counting costs about as
+// much as an ordinary increment; slots are only summed when a report is
+// made. Counters are always kept, the options just print them.
+enum class Stat : unsigned {
+    BYTES_IN,       // input bytes read, format sniffing and trailer included
+    BYTES_OUT,      // bytes written by the writer stage
+    BITS_IN,        // stream bits into the encoder / decoder
+    BITS_OUT,       // stream bits out of it
+    FRAMES,         // frames encoded, or good frames decoded
+    BAD_FRAMES,     // frames the decoder dropped, for any reason
+    CRC_ERRORS,     // of those, CRC mismatches
+    CONTENT_BITS,   // encoder: payload and CRC bits, before stuffing
+    STUFFED_BITS,   // encoder: 0s inserted by bit stuffing
+    READ_NS,        // reader stage busy in reads
+    WRITE_NS,       // writer stage busy in writes
+    WAIT_NS,        // coding thread waiting on I/O, or doing it itself
+    COUNT
+};
+
+// Add to / overwrite the calling thread's counter. stats_set() is for
+// totals one thread keeps anyway, such as a frame count.
+void stats_add(Stat stat, uint64_t n);
+void stats_set(Stat stat, uint64_t value);
+
+// Sum over all threads so far
+uint64_t stats_total(Stat stat);
+
+// Monotonic nanoseconds, and seconds since the program started
+uint64_t stats_now_ns();
+double stats_elapsed();
+
+// Adds the time from construction to destruction to a *_NS counter
+class StatClock {
+public:
+    explicit StatClock(Stat stat) : stat_(stat), start_(stats_now_ns()) {}
+    ~StatClock() { stats_add(stat_, stats_now_ns() - start_); }
+
+private:
+    Stat     stat_;
+    uint64_t start_;
+};
+
+// One JSON object on one line: wall time and per-stage busy time, bytes
+// and bits in and out, stuffing overhead, frame rate, CRC failure rate and
+// peak RSS
+std::string stats_json(const char* tool);
+
+// Prints a progress line to stderr every `interval` seconds until
+// destroyed; an interval of 0 or less prints nothing
+class StatsProgress {
+public:
+    StatsProgress(const char* tool, double interval);
+    ~StatsProgress();
+
+    StatsProgress(const StatsProgress&) = delete;
+    StatsProgress& operator=(const StatsProgress&) = delete;
+
+private:
+    const char* tool_;
+    double      interval_;
+    bool        stop_;
+    std::mutex  mutex_;
+    std::condition_variable wake_;
+    std::thread thread_;
+
+    void run();
+};
+
+#endif // STATS_H
@@ -0,0 +1,188 @@
+// stuffing.cpp
+#include "stuffing.h"
+
+namespace {
+
+// Destuffer states 0..4 are the run length, SKIP means "drop the next bit if 0"
+const unsigned SKIP = 5;
+
+// Per-byte transition tables. For each (state, byte): the produced bits
+// right-aligned in `bits`, how many there are, and the state afterwards.
+struct Entry {
+    uint16_t bits;
+    uint8_t  len;
+    uint8_t  next;
+};
+
+struct Tables {
+    Entry stuff[5][256];
+    Entry destuff[6][256];
+
+    Tables() {
+        for (unsigned s = 0; s < 5; ++s)
+            for (unsigned byte = 0; byte < 256; ++byte) {
+                unsigned st = s, bits = 0, len = 0;
+                for (int i = 7; i >= 0; --i) {
+                    unsigned b = (byte >> i) & 1;
+                    bits = (bits << 1) | b; ++len;
+                    if (b && ++st == 5) {
+                        bits <<= 1; ++len;
+                        st = 0;
+                    } else if (!b) {
+                        st = 0;
+                    }
+                }
+                stuff[s][byte] = Entry{static_cast<uint16_t>(bits),
+                                       static_cast<uint8_t>(len),
+                                       static_cast<uint8_t>(st)};
+            }
+        for (unsigned s = 0; s <= SKIP; ++s)
+            for (unsigned byte = 0; byte < 256; ++byte) {
+                unsigned st = s, bits = 0, len = 0;
+                for (int i = 7; i >= 0; --i) {
+                    unsigned b = (byte >> i) & 1;
+                    if (st == SKIP) {
+                        st = 0;
+                        if (!b) continue;
+                    }
+                    bits = (bits << 1) | b; ++len;
+                    if (b) {
+                        if (++st == 5) st = SKIP;
+                    } else {
+                        st = 0;
+                    }
+                }
+                destuff[s][byte] = Entry{static_cast<uint16_t>(bits),
+                                         static_cast<uint8_t>(len),
+                                         static_cast<uint8_t>(st)};
+            }
+    }
+};
+
+const Tables tables;
+
+// Bit p of the result is set when bits p..p+4 (MSB-first) are all 1
+inline uint64_t five_ones(uint64_t w) {
+    return w & (w << 1) & (w << 2) & (w << 3) & (w << 4);
+}
+
+inline unsigned leading_ones(uint64_t w) {
+    return ~w ? static_cast<unsigned>(__builtin_clzll(~w)) : 64;
+}
+
+inline unsigned trailing_ones(uint64_t w) {
+    return ~w ? static_cast<unsigned>(__builtin_ctzll(~w)) : 64;
+}
+
+// Run `nbytes` bytes taken from the top of `w` through a byte table,
+// collecting output in a local accumulator so BitBuffer sees whole words
+template <unsigned N>
+inline unsigned run_bytes(const Entry (&tab)[N][256], uint64_t w, unsigned nbytes,
+                          unsigned st, BitBuffer& out) {
+    uint64_t acc = 0;
+    unsigned nacc = 0;
+    for (unsigned i = 0; i < nbytes; ++i) {
+        const Entry& e = tab[st][(w >> (56 - 8 * i)) & 0xFF];
+        if (nacc + e.len > 64) {
+            out.append(acc, nacc);
+            acc = 0;
+            nacc = 0;
+        }
+        acc = (acc << e.len) | e.bits;
+        nacc += e.len;
+        st = e.next;
+    }
+    out.append(acc, nacc);
+    return st;
+}
+
+// Stuff all 64 bits of `w`, returning the run of 1s afterwards
+inline unsigned stuff_word(uint64_t w, unsigned ones, BitBuffer& out) {
+    // No run of five inside the word and the carried run cannot reach five
+    // either: the word passes through unchanged
+    if (five_ones(w) == 0 && ones + leading_ones(w) < 5) {
+        out.append(w, 64);
+        return trailing_ones(w);
+    }
+    return run_bytes(tables.stuff, w, 8, ones, out);
+}
+
+} // namespace
+
+void bit_stuff_word(uint64_t w, BitBuffer& out, StuffState& st) {
+    st.ones = stuff_word(w, st.ones, out);
+}
+
+void bit_stuff(const BitSpan& in, BitBuffer& out, StuffState& st) {
+    size_t full = in.size() / 64;
+    unsigned ones = st.ones;
+    for (size_t k = 0; k < full; ++k) ones = stuff_word(in.word(k), ones, out);
+    unsigned rest = in.size() & 63;
+    if (rest) {
+        uint64_t w = in.word(full);
+        ones = run_bytes(tables.stuff, w, rest / 8, ones, out);
+        for (unsigned i = rest & ~7u; i < rest; ++i) {
+            bool b = (w >> (63 - i)) & 1;
+            out.push_back(b);
+            if (b) {
+                if (++ones == 5) {
+                    out.push_back(false);
+                    ones = 0;
+                }
+            } else {
+                ones = 0;
+            }
+        }
+    }
+    st.ones = ones;
+}
+
+void bit_destuff(const BitSpan& in, BitBuffer& out, DestuffState& st) {
+    size_t full = in.size() / 64;
+    unsigned s = st.skip ? SKIP : st.ones;
+    for (size_t k = 0; k < full; ++k) {
+        uint64_t w = in.word(k);
+        if (s != SKIP && five_ones(w) == 0 && s + leading_ones(w) < 5) {
+            out.append(w, 64);
+            s = trailing_ones(w);
+        } else {
+            s = run_bytes(tables.destuff, w, 8, s, out);
+        }
+    }
+    unsigned rest = in.size() & 63;
+    if (rest) {
+        uint64_t w = in.word(full);
+        s = run_bytes(tables.destuff, w, rest / 8, s, out);
+        for (unsigned i = rest & ~7u; i < rest; ++i) {
+            bool b = (w >> (63 - i)) & 1;
+            if (s == SKIP) {
+                s = 0;
+                if (!b) continue;
+            }
+            out.push_back(b);
+            if (b) {
+                if (++s == 5) s = SKIP;
+            } else {
+                s = 0;
+            }
+        }
+    }
+    st.skip = (s == SKIP);
+    st.ones = st.skip ? 0 : s;
+}
+
+BitBuffer bit_stuff(const BitSpan& in) {
+    BitBuffer out;
+    out.reserve(in.size() + in.size() / 5 + 1);
+    StuffState st;
+    bit_stuff(in, out, st);
+    return out;
+}
+
+BitBuffer bit_destuff(const BitSpan& in) {
+    BitBuffer out;
+    out.reserve(in.size());
+    DestuffState st;
+    bit_destuff(in, out, st);
+    return out;
+}
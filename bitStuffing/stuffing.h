@@ -0,0 +1,38 @@
+// stuffing.h
+#ifndef STUFFING_H
+#define STUFFING_H
+
+#include "bitbuffer.h"
+
+// Stuffing state carried between calls: length of the current run of 1s
+struct StuffState {
+    unsigned ones;
+    StuffState() : ones(0) {}
+};
+
+// Destuffing state: run of 1s so far, and whether the next bit is a
+// candidate stuffed 0 (the previous bit completed a run of five)
+struct DestuffState {
+    unsigned ones;
+    bool     skip;
+    DestuffState() : ones(0), skip(false) {}
+};
+
+// Append `in` to `out` with a 0 inserted after every five consecutive 1s.
+// Works 64 input bits per step; runs crossing call boundaries continue
+// through `st`.
+void bit_stuff(const BitSpan& in, BitBuffer& out, StuffState& st);
+
+// bit_stuff() of the 64 bits of one word, MSB first, for kernels that
+// stuff a word as they go
+void bit_stuff_word(uint64_t w, BitBuffer& out, StuffState& st);
+
+// Append `in` to `out`, dropping any 0 that follows five consecutive 1s
+void bit_destuff(const BitSpan& in, BitBuffer& out, DestuffState& st);
+
+// One-shot forms starting from a fresh state. A run of five 1s at the very
+// end of the input has no following bit, so nothing is dropped for it.
+BitBuffer bit_stuff(const BitSpan& in);
+BitBuffer bit_destuff(const BitSpan& in);
+
+#endif // STUFFING_H
@@ -0,0 +1,96 @@
+// threadpool.cpp
+#include "threadpool.h"
+
+namespace {
+
+// Which pool and worker the current thread is, so submits from inside a
+// task stay local
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local unsigned          current_worker = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threads)
+    : pending_(0),
+      next_(0),
+      stop_(false)
+{
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    for (unsigned i = 0; i < threads; ++i) queues_.emplace_back(new Queue);
+    for (unsigned i = 0; i < threads; ++i) workers_.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& w : workers_) w.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    unsigned target = current_pool == this ? current_worker
+                                           : next_.fetch_add(1) % size();
+    pending_.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+        queues_[target]->tasks.push_back(std::move(task));
+    }
+    {
+        // Taken so a worker between its check and its wait cannot miss this
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+    }
+    wake_.notify_one();
+}
+
+// Own deque from the back (most recent, still warm in cache), others from
+// the front
+bool ThreadPool::pop(unsigned self, std::function<void()>& task) {
+    {
+        Queue& q = *queues_[self];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+            return true;
+        }
+    }
+    for (unsigned k = 1; k < size(); ++k) {
+        Queue& q = *queues_[(self + k) % size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::run_one() {
+    unsigned self = current_pool == this ? current_worker : next_.load() % size();
+    std::function<void()> task;
+    if (!pop(self, task)) return false;
+    pending_.fetch_sub(1);
+    task();
+    return true;
+}
+
+void ThreadPool::run(unsigned self) {
+    current_pool = this;
+    current_worker = self;
+    std::function<void()> task;
+    for (;;) {
+        if (pop(self, task)) {
+            pending_.fetch_sub(1);
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait(lock, [&] { return stop_ || pending_.load() > 0; });
+        if (stop_ && pending_.load() == 0) return;
+    }
+}
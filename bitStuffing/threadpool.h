@@ -0,0 +1,107 @@
+// threadpool.h
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. A worker runs
+// its newest task first and, when its deque is empty, steals the oldest task
+// of another worker, so uneven tasks still keep every thread busy.
+class ThreadPool {
+public:
+    // 0 threads means one per hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();      // runs the remaining tasks, then joins
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queue a task; from a worker it goes to that worker's own deque
+    void submit(std::function<void()> task);
+
+    unsigned size() const { return static_cast<unsigned>(queues_.size()); }
+
+    // Run one queued task on the calling thread, if there is one. A task
+    // waiting for tasks it submitted calls this instead of blocking, so it
+    // cannot starve the pool of workers.
+    bool run_one();
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex              sleep_mutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t>     pending_;
+    std::atomic<unsigned>   next_;      // round-robin target for outside submits
+    bool                    stop_;
+
+    void run(unsigned self);
+    bool pop(unsigned self, std::function<void()>& task);
+};
+
+// Hands results produced out of order back in sequence order. Producers
+// put() result `seq` from any thread; one consumer takes 0, 1, 2, ...
+template <class T>
+class ReorderBuffer {
+public:
+    ReorderBuffer() : next_(0) {}
+
+    // Notifies under the lock: once the consumer has taken the last result
+    // it may destroy the buffer, and no producer may still be touching it
+    void put(size_t seq, T value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_.insert(std::make_pair(seq, std::move(value)));
+        ready_.notify_all();
+    }
+
+    // Take the next result in sequence if it has arrived
+    bool try_take(T& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return take_locked(value);
+    }
+
+    // Wait for the next result in sequence
+    T take() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        T value;
+        ready_.wait(lock, [&] { return take_locked(value); });
+        return value;
+    }
+
+    // Sequence number of the next result to be taken
+    size_t next() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return next_;
+    }
+
+private:
+    mutable std::mutex      mutex_;
+    std::condition_variable ready_;
+    std::map<size_t, T>     done_;
+    size_t                  next_;
+
+    bool take_locked(T& value) {
+        auto it = done_.find(next_);
+        if (it == done_.end()) return false;
+        value = std::move(it->second);
+        done_.erase(it);
+        ++next_;
+        return true;
+    }
+};
+
+#endif // THREADPOOL_H
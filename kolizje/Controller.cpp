@@ -1,45 +1,89 @@
 // Controller.cpp
 #include "Controller.h"
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
 #include <thread>
 #include <chrono>
 
-// Constructor: store references, seed RNG, clear network
-Controller::Controller(std::vector<std::string>& network,
+// Constructor: store references, number transmitters, seed RNG, clear network
+Controller::Controller(int networkLength,
                        std::vector<Transmitter*>& transmitterList,
                        int printSpeed,
                        int delayRange)
-    : network(network),
+    : network(networkLength, CELL_EMPTY),
       transmitterList(transmitterList),
+      emptyCells(networkLength),
+      jamCells(0),
+      ownCells(transmitterList.size(), 0),
       arrayNoised(false),
       rng(std::random_device{}()),
       delayCounter(0),
       printSpeed(printSpeed),
       delayRange(delayRange),
-      changeWaitTime(false)
+      changeWaitTime(false),
+      quiet(false)
 {
+    // Each transmitter needs a cell value of its own
+    if (transmitterList.size() > MAX_TRANSMITTERS) {
+        throw std::invalid_argument("Controller: more than MAX_TRANSMITTERS transmitters");
+    }
+    for (size_t i = 0; i < transmitterList.size(); ++i) {
+        transmitterList[i]->id = static_cast<int>(i);
+    }
     clearNetwork();
 }
 
-// Checks if the cell at transmitter->position is " " (empty)
+// Adds d to the number of cells holding value
+void Controller::countCell(uint8_t value, int d) {
+    if (value == CELL_EMPTY) {
+        emptyCells += d;
+    } else if (value == CELL_JAM) {
+        jamCells += d;
+    } else {
+        ownCells[value - CELL_FIRST_ID] += d;
+    }
+}
+
+// Writes a cell, moving it from one count to another
+void Controller::setCell(int pos, uint8_t value) {
+    if (network[pos] == value) {
+        return;
+    }
+    countCell(network[pos], -1);
+    countCell(value, 1);
+    network[pos] = value;
+}
+
+// The cell value of transmitter's signal
+uint8_t Controller::cellOf(const Transmitter* transmitter) const {
+    return static_cast<uint8_t>(CELL_FIRST_ID + transmitter->id);
+}
+
+// Checks if the cell at transmitter->position is empty
 bool Controller::checkIfPossibleTransmission(Transmitter* transmitter) {
-    return network[transmitter->position] == " ";
+    return network[transmitter->position] == CELL_EMPTY;
 }
 
-// Checks if at this position there is something other than " " or "#"
+// Checks if at this position there is something other than empty or "#"
 bool Controller::isOtherTransmitting(Transmitter* transmitter) {
-    const std::string& cell = network[transmitter->position];
-    return !(cell == " " || cell == "#");
+    uint8_t cell = network[transmitter->position];
+    return !(cell == CELL_EMPTY || cell == CELL_JAM);
 }
 
-// Doubles attemptCounter, maybe prints “FAILED,” then recalculates waitTime
+// Doubles attemptCounter up to 1024, maybe prints “FAILED,” then
+// recalculates waitTime
 void Controller::waitTimeAdd(Transmitter* transmitter) {
-    transmitter->attemptCounter *= 2;
-    if (transmitter->attemptCounter > 1024) {
-        if (transmitter->transmissionFailCounter == 6) {
+    TransmitterResult& result = results[transmitter->id];
+    result.collisions++;
+    if (transmitter->attemptCounter >= 1024) {
+        if (transmitter->transmissionFailCounter == 6 && !quiet) {
             std::cout << "TRANSMISSION " << transmitter->name << " FAILED\n";
         }
         transmitter->transmissionFailCounter++;
+        result.cappedBackoffs++;
+    } else {
+        transmitter->attemptCounter *= 2;
     }
     std::uniform_int_distribution<int> dist(0, transmitter->attemptCounter - 1);
     int randomBackoff = dist(rng) + 1;
@@ -56,12 +100,7 @@ void Controller::randomizeDelay() {
 
 // Returns true if every cell in network is "#"
 bool Controller::checkIfArrayNoised() {
-    for (const auto& cell : network) {
-        if (cell != "#") {
-            return false;
-        }
-    }
-    return true;
+    return jamCells == static_cast<int>(network.size());
 }
 
 // Clears the “message” of a transmitter after a collision or success
@@ -83,16 +122,16 @@ void Controller::startClearingMSG(Transmitter* transmitter) {
     // Clear one step at a time on each side
     if (transmitter->signalPositionR < static_cast<int>(network.size())) {
         if (toLeft) {
-            network[transmitter->position] = " ";
+            setCell(transmitter->position, CELL_EMPTY);
         }
-        network[transmitter->signalPositionR] = " ";
+        setCell(transmitter->signalPositionR, CELL_EMPTY);
         transmitter->signalPositionR++;
     }
     if (transmitter->signalPositionL >= 0) {
         if (toRight) {
-            network[transmitter->position] = " ";
+            setCell(transmitter->position, CELL_EMPTY);
         }
-        network[transmitter->signalPositionL] = " ";
+        setCell(transmitter->signalPositionL, CELL_EMPTY);
         transmitter->signalPositionL--;
     }
 
@@ -130,16 +169,16 @@ void Controller::startClearing(Transmitter* transmitter) {
     // Clear one cell on each side
     if (transmitter->signalPositionR < static_cast<int>(network.size())) {
         if (toLeft) {
-            network[transmitter->position] = " ";
+            setCell(transmitter->position, CELL_EMPTY);
         }
-        network[transmitter->signalPositionR] = " ";
+        setCell(transmitter->signalPositionR, CELL_EMPTY);
         transmitter->signalPositionR++;
     }
     if (transmitter->signalPositionL >= 0) {
         if (toRight) {
-            network[transmitter->position] = " ";
+            setCell(transmitter->position, CELL_EMPTY);
         }
-        network[transmitter->signalPositionL] = " ";
+        setCell(transmitter->signalPositionL, CELL_EMPTY);
         transmitter->signalPositionL--;
     }
 
@@ -148,7 +187,7 @@ void Controller::startClearing(Transmitter* transmitter) {
         transmitter->msgSent = false;
     }
 
-    // Once the entire array is " ", reset everything
+    // Once the entire array is empty, reset everything
     if (arrayClear()) {
         arrayNoised = false;
         if (!transmitter->msgSent) {
@@ -163,21 +202,16 @@ void Controller::startClearing(Transmitter* transmitter) {
     }
 }
 
-// Returns true if every cell in network is " " (empty)
+// Returns true if every cell in network is empty
 bool Controller::arrayClear() {
-    for (const auto& cell : network) {
-        if (cell != " ") {
-            return false;
-        }
-    }
-    return true;
+    return emptyCells == static_cast<int>(network.size());
 }
 
 // Advances the message one step on each side if still transmitting
 void Controller::continueTransmission(Transmitter* transmitter) {
     // Place the transmitter’s letter at its own position if empty
-    if (transmitter->transmitting && network[transmitter->position] == " ") {
-        network[transmitter->position] = transmitter->name;
+    if (transmitter->transmitting && network[transmitter->position] == CELL_EMPTY) {
+        setCell(transmitter->position, cellOf(transmitter));
     }
 
     // Send rightward
@@ -196,16 +230,21 @@ void Controller::continueTransmission(Transmitter* transmitter) {
         transmitter->signalPositionR = transmitter->position + 1;
     }
 
+    bool wasSent = transmitter->msgSent;
     transmitter->msgSent = checkIfMsgSent(transmitter);
+    if (transmitter->msgSent && !wasSent) {
+        results[transmitter->id].successes++;
+    }
 }
 
 // Place a letter or "#" at signalPositionR
 void Controller::sendMsgRight(Transmitter* transmitter) {
     int rp = transmitter->signalPositionR;
-    if (network[rp] != " " && network[rp] != transmitter->name) {
-        network[rp] = "#";
+    uint8_t own = cellOf(transmitter);
+    if (network[rp] != CELL_EMPTY && network[rp] != own) {
+        setCell(rp, CELL_JAM);
     } else {
-        network[rp] = transmitter->name;
+        setCell(rp, own);
     }
     transmitter->signalPositionR++;
 }
@@ -213,107 +252,148 @@ void Controller::sendMsgRight(Transmitter* transmitter) {
 // Place a letter or "#" at signalPositionL
 void Controller::sendMsgLeft(Transmitter* transmitter) {
     int lp = transmitter->signalPositionL;
-    if (network[lp] != " " && network[lp] != transmitter->name) {
-        network[lp] = "#";
+    uint8_t own = cellOf(transmitter);
+    if (network[lp] != CELL_EMPTY && network[lp] != own) {
+        setCell(lp, CELL_JAM);
     } else {
-        network[lp] = transmitter->name;
+        setCell(lp, own);
     }
     transmitter->signalPositionL--;
 }
 
 // Print the entire network, with no spaces between cells, and "#" for collisions
 void Controller::printNetwork() {
-    for (const auto& cell : network) {
-        // If it is " ", print a space
-        if (cell == " ") {
-            std::cout << " ";
+    std::string line;
+    for (uint8_t cell : network) {
+        // Empty cells print as a space
+        if (cell == CELL_EMPTY) {
+            line += " ";
         }
-        // If it is "#", print "#"
-        else if (cell == "#") {
-            std::cout << "#";
+        else if (cell == CELL_JAM) {
+            line += "#";
         }
         // Otherwise it's a transmitter letter (e.g. "A", "B", "C")
         else {
-            std::cout << cell;
+            line += transmitterList[cell - CELL_FIRST_ID]->name;
         }
     }
-    std::cout << "\n";
+    std::cout << line << "\n";
 }
 
-// Fill every slot in network with " "
+// Empty every slot in network
 void Controller::clearNetwork() {
-    for (auto& cell : network) {
-        cell = " ";
-    }
+    std::fill(network.begin(), network.end(), CELL_EMPTY);
+    emptyCells = static_cast<int>(network.size());
+    jamCells = 0;
+    std::fill(ownCells.begin(), ownCells.end(), 0);
 }
 
-// Returns true if every cell contains exactly transmitter->name
+// Returns true if every cell carries transmitter's signal
 bool Controller::checkIfMsgSent(Transmitter* transmitter) {
-    for (const auto& cell : network) {
-        if (cell != transmitter->name) {
-            return false;
-        }
-    }
-    return true;
+    return ownCells[transmitter->id] == static_cast<int>(network.size());
 }
 
-// The endless loop that mimics Controller.run() in Java
-void Controller::run() {
+// Draws the initial delays and zeroes the tallies
+void Controller::start() {
     delayCounter = 1;
     randomizeDelay();
+    results.clear();
+    for (auto* t : transmitterList) {
+        results.push_back(TransmitterResult{t->name, 0, 0, 0});
+    }
+}
 
-    while (true) {
-        for (auto* transmitter : transmitterList) {
-            bool failTransmission = false;
+// One step of every transmitter
+void Controller::tick() {
+    for (auto* transmitter : transmitterList) {
+        bool failTransmission = false;
 
-            if (transmitter->delay <= delayCounter) {
-                if (arrayNoised) {
-                    startClearing(transmitter);
-                }
-                else if (transmitter->msgSent) {
-                    transmitter->attemptCounter = 1;
-                    startClearingMSG(transmitter);
-                }
-                else if (checkIfArrayNoised()) {
-                    arrayNoised = true;
-                    changeWaitTime = true;
-                }
-                else if (transmitter->transmitting) {
-                    if (transmitter->waitTime < 2) {
-                        continueTransmission(transmitter);
-                    } else {
-                        transmitter->waitTime--;
-                        transmitter->transmitting = false;
-                    }
-                }
-                else if (checkIfPossibleTransmission(transmitter)) {
-                    transmitter->transmitting = true;
+        if (transmitter->delay <= delayCounter) {
+            if (arrayNoised) {
+                startClearing(transmitter);
+            }
+            else if (transmitter->msgSent) {
+                transmitter->attemptCounter = 1;
+                startClearingMSG(transmitter);
+            }
+            else if (checkIfArrayNoised()) {
+                arrayNoised = true;
+                changeWaitTime = true;
+            }
+            else if (transmitter->transmitting) {
+                if (transmitter->waitTime < 2) {
+                    continueTransmission(transmitter);
+                } else {
                     transmitter->waitTime--;
+                    transmitter->transmitting = false;
                 }
-                else if (isOtherTransmitting(transmitter)) {
-                    if (transmitter->waitTime < 2) {
-                        failTransmission = true;
-                    } else {
-                        transmitter->waitTime--;
-                    }
+            }
+            else if (checkIfPossibleTransmission(transmitter)) {
+                transmitter->transmitting = true;
+                transmitter->waitTime--;
+            }
+            else if (isOtherTransmitting(transmitter)) {
+                if (transmitter->waitTime < 2) {
+                    failTransmission = true;
+                } else {
+                    transmitter->waitTime--;
                 }
             }
+        }
 
-            if (failTransmission) {
-                waitTimeAdd(transmitter);
-            }
-            else if (changeWaitTime) {
-                changeWaitTime = false;
-                for (auto* t : transmitterList) {
-                    if (t->waitTime < 2) {
-                        waitTimeAdd(t);
-                    }
+        if (failTransmission) {
+            waitTimeAdd(transmitter);
+        }
+        else if (changeWaitTime) {
+            changeWaitTime = false;
+            for (auto* t : transmitterList) {
+                if (t->waitTime < 2) {
+                    waitTimeAdd(t);
                 }
             }
         }
+    }
+}
 
+// The endless loop that mimics Controller.run() in Java
+void Controller::run() {
+    start();
+
+    while (true) {
+        tick();
         printNetwork();
         std::this_thread::sleep_for(std::chrono::milliseconds(printSpeed));
         delayCounter++;
     }
 }
+
+// The same steps as run(), as fast as they go
+RunResult Controller::runHeadless(long maxTicks, bool untilDelivered) {
+    if (maxTicks <= 0 && !untilDelivered) {
+        throw std::invalid_argument("runHeadless: no tick limit and not untilDelivered");
+    }
+    start();
+    quiet = true;
+
+    RunResult result;
+    result.ticks = 0;
+    result.allDelivered = false;
+    while (maxTicks <= 0 || result.ticks < maxTicks) {
+        tick();
+        delayCounter++;
+        result.ticks++;
+
+        result.allDelivered = true;
+        for (const auto& r : results) {
+            if (r.successes == 0) {
+                result.allDelivered = false;
+            }
+        }
+        if (untilDelivered && result.allDelivered) {
+            break;
+        }
+    }
+    quiet = false;
+    result.transmitters = results;
+    return result;
+}
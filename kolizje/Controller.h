@@ -2,14 +2,41 @@
 #ifndef CONTROLLER_H
 #define CONTROLLER_H
 
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <random>
 #include "Transmitter.h"
 
+// Network cells: empty, jammed ("#"), or carrying the signal of the
+// transmitter with id (cell - CELL_FIRST_ID)
+const uint8_t CELL_EMPTY    = 0;
+const uint8_t CELL_JAM      = 1;
+const uint8_t CELL_FIRST_ID = 2;
+const size_t  MAX_TRANSMITTERS = 256 - CELL_FIRST_ID;
+
+// Per-transmitter tally of a headless run
+struct TransmitterResult {
+    std::string name;
+    int successes;      // messages that filled the whole network
+    int collisions;     // backoffs drawn after a busy or noised network
+    int cappedBackoffs; // of those, drawn with attemptCounter already at the
+                        // 1024 limit (not transmitters that gave up: a
+                        // transmitter keeps trying after any number of them)
+};
+
+// Outcome of Controller::runHeadless()
+struct RunResult {
+    long ticks;
+    bool allDelivered;  // every transmitter got at least one message through
+    std::vector<TransmitterResult> transmitters;
+};
+
 class Controller {
 public:
-    Controller(std::vector<std::string>& network,
+    // Numbers the transmitters (Transmitter::id) in list order; throws
+    // std::invalid_argument for more than MAX_TRANSMITTERS of them
+    Controller(int networkLength,
                std::vector<Transmitter*>& transmitterList,
                int printSpeed,
                int delayRange);
@@ -17,17 +44,35 @@ public:
     // Runs the endless loop of checking transmissions, printing, and sleeping
     void run();
 
+    // Runs without printing or sleeping until maxTicks ticks have passed
+    // (0 or less: no limit) or, with untilDelivered, until every
+    // transmitter has delivered a message. Throws std::invalid_argument
+    // when neither is set, as the run would never end.
+    RunResult runHeadless(long maxTicks, bool untilDelivered);
+
 private:
-    std::vector<std::string>& network;
+    std::vector<uint8_t> network;
     std::vector<Transmitter*>& transmitterList;
+    // Cells holding CELL_EMPTY, CELL_JAM and each transmitter's signal,
+    // kept up to date by setCell()
+    int emptyCells;
+    int jamCells;
+    std::vector<int> ownCells;
     bool arrayNoised;
     std::mt19937 rng;
     int delayCounter;
     int printSpeed;
     int delayRange;
     bool changeWaitTime;
+    bool quiet;
+    std::vector<TransmitterResult> results;   // same order as transmitterList
 
     // Helper methods
+    void start();
+    void tick();
+    void countCell(uint8_t value, int d);
+    void setCell(int pos, uint8_t value);
+    uint8_t cellOf(const Transmitter* transmitter) const;
     bool checkIfPossibleTransmission(Transmitter* transmitter);
     bool isOtherTransmitting(Transmitter* transmitter);
     void waitTimeAdd(Transmitter* transmitter);
@@ -12,6 +12,7 @@ Transmitter::Transmitter(const std::string& name, int position, const std::strin
       msgSent(false),
       color(color),
       waitTime(0),
-      transmissionFailCounter(0)
+      transmissionFailCounter(0),
+      id(0)
 {
 }
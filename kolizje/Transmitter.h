@@ -18,6 +18,7 @@ public:
     std::string color;
     int waitTime;
     int transmissionFailCounter;
+    int id;     // index in the Controller's list, set by the Controller
 
     Transmitter(const std::string& name, int position, const std::string& color);
 };
@@ -0,0 +1,235 @@
+// csma.cpp
+#include "csma.h"
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <queue>
+
+Node::Node(char n, int pos, int tx, const Rng& rng) : name(n), position(pos), rng(rng) {
+    if (tx < 0) {
+        transmission_tick = (int)this->rng.below(1001);
+    } else {
+        transmission_tick = tx;//1;
+    }
+}
+
+int draw_backoff(Node& node) {
+    int factor = 1 << node.attempts;
+    return (int)node.rng.below(factor);
+}
+
+namespace {
+
+const long long NEVER = std::numeric_limits<long long>::max();
+
+// Ticks [first, last]
+struct Span {
+    long long first;
+    long long last;
+};
+
+struct EventNode {
+    Node      node;
+    long long tx;           // tick it next tries to start (transmission_tick)
+    bool      waiting;      // it will try: tx has not gone by
+    long long start;        // of the current transmission
+    long long jam_start;
+    long long next;         // earliest tick its state can change
+    NodeStats stats;
+    // Ticks it puts a signal on the wire (which reaches a node d cells away
+    // d ticks later) and ticks it writes its own cell (which only nodes at
+    // the same position, later in the list, see in the same tick). The last
+    // entry of each may be a plan that a collision cuts short.
+    std::vector<Span> sends;
+    std::vector<Span> writes;
+
+    explicit EventNode(const Node& n)
+        : node(n), tx(n.transmission_tick), waiting(n.transmission_tick >= 1),
+          start(0), jam_start(0), next(NEVER),
+          stats{n.name, -1, 0} {}
+};
+
+class EventEngine {
+public:
+    EventEngine(const std::vector<Node>& nodes, int length)
+        : L(length)
+    {
+        for (const Node& n : nodes) this->nodes.emplace_back(n);
+    }
+
+    SimStats run();
+
+private:
+    long long L;
+    std::vector<EventNode> nodes;
+    // (tick, node) of every planned event; an entry whose tick is no longer
+    // the node's `next` has been replanned and is skipped
+    typedef std::pair<long long, size_t> Event;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> queue;
+
+    void schedule(size_t n, long long t) {
+        if (t == nodes[n].next) return;
+        nodes[n].next = t;
+        if (t != NEVER) queue.push(Event(t, n));
+    }
+
+    // The spans of m's activity as heard at n's position, shifted to the
+    // ticks they arrive; false when n cannot hear m at all
+    bool heard(size_t n, size_t m, const std::vector<Span>*& spans, long long& delay) const {
+        if (m == n) return false;
+        delay = std::abs(nodes[m].node.position - nodes[n].node.position);
+        if (delay == 0) {
+            if (m > n) return false;        // written after n looked, and gone next tick
+            spans = &nodes[m].writes;
+        } else {
+            spans = &nodes[m].sends;
+        }
+        return true;
+    }
+
+    // Earliest tick in [lo, hi] at which n hears anything, or NEVER
+    long long first_busy(size_t n, long long lo, long long hi) const {
+        long long best = NEVER;
+        for (size_t m = 0; m < nodes.size(); ++m) {
+            const std::vector<Span>* spans;
+            long long d;
+            if (!heard(n, m, spans, d)) continue;
+            for (const Span& s : *spans) {
+                long long a = std::max(s.first + d, lo), b = std::min(s.last + d, hi);
+                if (a <= b) best = std::min(best, a);
+            }
+        }
+        return best;
+    }
+
+    // Earliest tick from `t` on at which n hears nothing
+    long long first_idle(size_t n, long long t) const {
+        for (bool moved = true; moved;) {
+            moved = false;
+            for (size_t m = 0; m < nodes.size(); ++m) {
+                const std::vector<Span>* spans;
+                long long d;
+                if (!heard(n, m, spans, d)) continue;
+                for (const Span& s : *spans)
+                    if (s.first + d <= t && t <= s.last + d) {
+                        t = s.last + d + 1;
+                        moved = true;
+                    }
+            }
+        }
+        return t;
+    }
+
+    // When n's state can next change, looking from tick `from` on
+    long long next_event(size_t n, long long from) const {
+        const EventNode& e = nodes[n];
+        switch (e.node.state) {
+        case NodeState::IDLE:
+            // It tries every tick from tx on until it hears nothing
+            return e.waiting ? first_idle(n, std::max(e.tx, from)) : NEVER;
+        case NodeState::TRANSMITTING:
+            return std::min(first_busy(n, std::max(from, e.start + 1), e.start + 2 * L),
+                            e.start + 2 * L);
+        case NodeState::JAMMING:
+            return e.jam_start + 2 * L;
+        default:
+            return NEVER;
+        }
+    }
+
+    // After n's plans changed at tick t, every other node looks again: those
+    // before n in the list are done with tick t, those after it are not
+    void replan(size_t n, long long t) {
+        for (size_t m = 0; m < nodes.size(); ++m)
+            if (m != n) schedule(m, next_event(m, m < n ? t + 1 : t));
+    }
+
+    // Spans that can no longer be heard anywhere on the medium
+    void prune(long long t) {
+        for (EventNode& e : nodes)
+            for (std::vector<Span>* v : {&e.sends, &e.writes})
+                v->erase(std::remove_if(v->begin(), v->end(),
+                                        [&](const Span& s) { return s.last + L < t; }),
+                         v->end());
+    }
+
+    // Tick t of node n, as the tick engine runs it
+    void step(size_t n, long long t);
+};
+
+void EventEngine::step(size_t n, long long t) {
+    EventNode& e = nodes[n];
+    Node& node = e.node;
+    bool busy = first_busy(n, t, t) != NEVER;
+    if (node.state == NodeState::IDLE) {
+        if (!e.waiting || t < e.tx || busy) return;
+        node.state = NodeState::TRANSMITTING;
+        e.waiting = false;
+        e.tx = e.start = t;
+        e.sends.push_back(Span{t, t + 2 * L - 1});
+        e.writes.push_back(Span{t, t + 2 * L});
+        replan(n, t);
+    } else if (node.state == NodeState::TRANSMITTING) {
+        if (busy) {
+            // Collision: it falls silent for this tick, then jams
+            node.state = NodeState::JAMMING;
+            e.sends.back().last = t - 1;
+            e.writes.back().last = t;
+            if (node.attempts < MAX_ATTEMPTS) {
+                long long backoff = 2 * L * draw_backoff(node);
+                e.tx = t + 2 * L + 1 + backoff;
+                e.waiting = true;
+            } else if (node.attempts > MAX_ATTEMPTS + 6) {
+                node.state = NodeState::IDLE;
+            }
+            node.attempts++;
+            e.stats.collisions++;
+            e.jam_start = t;
+            if (node.state == NodeState::JAMMING) {
+                e.sends.push_back(Span{t + 1, t + 2 * L - 1});
+                e.writes.push_back(Span{t + 1, t + 2 * L - 1});
+            }
+            replan(n, t);
+        } else if (t >= e.start + 2 * L) {
+            node.state = NodeState::SUCCESS;
+            e.stats.success_tick = t;
+        }
+    } else if (node.state == NodeState::JAMMING) {
+        if (t >= e.jam_start + 2 * L) node.state = NodeState::IDLE;
+    }
+}
+
+SimStats EventEngine::run() {
+    for (size_t n = 0; n < nodes.size(); ++n) schedule(n, next_event(n, 1));
+    long long t = 0;
+    size_t events = 0;
+    // Ties go in list order, as in the tick engine
+    while (!queue.empty()) {
+        Event ev = queue.top();
+        queue.pop();
+        size_t n = ev.second;
+        if (ev.first != nodes[n].next) continue;
+        t = ev.first;
+        step(n, t);
+        schedule(n, next_event(n, t + 1));
+        if (++events % 1024 == 0) prune(t);
+    }
+
+    SimStats stats;
+    stats.ticks = 0;
+    stats.complete = true;
+    for (const EventNode& e : nodes) {
+        stats.nodes.push_back(e.stats);
+        if (e.stats.success_tick < 0) stats.complete = false;
+        stats.ticks = std::max(stats.ticks, e.stats.success_tick);
+    }
+    if (!stats.complete) stats.ticks = t;
+    return stats;
+}
+
+} // namespace
+
+SimStats run_events(const std::vector<Node>& nodes, int length) {
+    return EventEngine(nodes, length).run();
+}
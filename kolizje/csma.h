@@ -0,0 +1,112 @@
+// csma.h
+#ifndef CSMA_H
+#define CSMA_H
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+constexpr int MEDIUM_LENGTH = 80;
+constexpr int MAX_ATTEMPTS   = 10;
+
+// splitmix64 finaliser: neighbouring inputs give unrelated outputs
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// xoshiro256**: 32 bytes of state, a few cycles a number. Rng(seed, k) is
+// stream k of a run seeded with `seed`; stream 0 lays out the scenario and
+// node i draws from stream i + 1, so a run replays exactly from its seed.
+// Usable with the <random> distributions.
+class Rng {
+public:
+    typedef uint64_t result_type;
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return std::numeric_limits<uint64_t>::max(); }
+
+    explicit Rng(uint64_t seed = 0, uint64_t stream = 0) {
+        uint64_t x = mix64(seed) ^ mix64(~stream);
+        for (uint64_t& w : s) w = x = mix64(x);
+    }
+
+    uint64_t operator()() {
+        uint64_t r = rotl(s[1] * 5, 7) * 9, t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return r;
+    }
+
+    // Uniform in [0, n), n >= 1
+    uint64_t below(uint64_t n) {
+        uint64_t limit = max() - max() % n;    // reject the uneven tail
+        uint64_t r;
+        while ((r = (*this)()) >= limit) {}
+        return r % n;
+    }
+
+private:
+    uint64_t s[4];
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+enum class NodeState {
+    IDLE,
+    TRANSMITTING,
+    BACKOFF,
+    JAMMING,
+    SUCCESS
+};
+
+struct Node {
+    char      name;
+    int       position;
+    int       transmission_tick=0;
+    NodeState state    = NodeState::IDLE;
+    int       backoff  = 0;
+    int       attempts = 0;
+    int       jam_start = 0;
+    Rng       rng;          // its own stream, for its start tick and backoffs
+
+    // tx < 0: start at a random tick in [0, 1000]
+    Node(char n, int pos, int tx, const Rng& rng);
+
+    std::string to_string() const {
+        return std::string(1, name) + "(x=" + std::to_string(position) + ")";
+    }
+};
+
+// Backoff of a node after its collision number `attempts` (0-based), in
+// slots of 2 * length ticks: uniform in [0, 2^attempts), from its stream
+int draw_backoff(Node& node);
+
+// What happened to one node
+struct NodeStats {
+    char      name;
+    long long success_tick;     // -1: never got its frame through
+    int       collisions;
+};
+
+// Outcome of a run, the same whichever engine produced it
+struct SimStats {
+    long long ticks;            // last tick simulated
+    bool      complete;         // every node succeeded
+    std::vector<NodeStats> nodes;
+};
+
+// Event-driven engine: the same model as the tick engine in test.cpp, but
+// each node's signal reaches another `distance` ticks after it is sent, so
+// only starts, collisions, jam ends, backoff expiries and the moments a
+// busy node hears the medium go idle are simulated. The cost depends on
+// the number of transmissions, not on the medium length or the run length.
+// Stops when every node has succeeded or can no longer transmit.
+SimStats run_events(const std::vector<Node>& nodes, int length);
+
+#endif // CSMA_H
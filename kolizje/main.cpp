@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <iostream>
 #include <vector>
 #include <string>
@@ -14,14 +15,38 @@ const std::string CYAN   = "\033[36m";
 const std::string WHITE  = "\033[37m";
 const std::string RESET  = "\033[0m";
 
-int main() {
+// Prints the tallies of a headless run, one transmitter per line
+static void printResult(const RunResult& result) {
+    std::cout << "ticks " << result.ticks
+              << (result.allDelivered ? " (all delivered)" : " (not all delivered)") << "\n";
+    for (const auto& t : result.transmitters) {
+        std::cout << t.name << ": successes " << t.successes
+                  << ", collisions " << t.collisions
+                  << ", capped backoffs " << t.cappedBackoffs << "\n";
+    }
+}
+
+// Without arguments the network is animated forever. --ticks N and/or
+// --until-delivered run it headless and print a summary instead.
+int main(int argc, char** argv) {
+    long maxTicks = 0;
+    bool untilDelivered = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--ticks" && i + 1 < argc) {
+            maxTicks = std::strtol(argv[++i], nullptr, 10);
+        } else if (arg == "--until-delivered") {
+            untilDelivered = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--ticks N] [--until-delivered]\n";
+            return 1;
+        }
+    }
+
     const int networkLength = 100;
     const int printSpeed    = 40;   // milliseconds between prints
     const int delayRange    = 100;  // range for initial random delays
 
-    // Create a network of length 60, all initialized to "0"
-    std::vector<std::string> network(networkLength, "0");
-
     // Instantiate three Transmitters exactly as in Java
     Transmitter t1("A", 30, YELLOW);
     Transmitter t2("B", 10, CYAN);
@@ -34,7 +59,11 @@ int main() {
     transmitters.push_back(&t3);
 
     // Instantiate the controller and start the run loop
-    Controller ctrl(network, transmitters, printSpeed, delayRange);
+    Controller ctrl(networkLength, transmitters, printSpeed, delayRange);
+    if (maxTicks > 0 || untilDelivered) {
+        printResult(ctrl.runHeadless(maxTicks, untilDelivered));
+        return 0;
+    }
     ctrl.run();  // this never returns
 
     return 0;
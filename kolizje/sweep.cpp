@@ -0,0 +1,236 @@
+// sweep.cpp
+// Monte Carlo sweep over the event-driven CSMA/CD engine (csma.h).
+//
+//   g++ -std=c++17 -O2 -pthread sweep.cpp csma.cpp -o sweep
+//   ./sweep --nodes 2,4,8 --length 80,1000 --start uniform:100,poisson:500
+//           --reps 1000 --seed 42 [--threads N] [--format csv|json]
+//
+// Every (nodes, length, start) combination is one cell of the grid and is
+// run --reps times. Each replication has its own seed, derived from the
+// master seed and the replication's place in the grid only; its scenario
+// and its nodes' backoffs come from streams of that seed (Rng), so the
+// output does not depend on the number of threads. A cell's line is
+// written as soon as it and every cell before it are done. The master
+// seed is recorded in the output: a "# seed" line above the CSV header,
+// or the "seed" field of the JSON object.
+#include "csma.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How the nodes' first transmission ticks are spread
+struct StartDist {
+    std::string name;       // as given on the command line
+    bool        poisson;    // exponential gaps of mean `width` between starts
+    int         width;      // else uniform in [1, width]
+};
+
+struct Cell {
+    int       nodes;
+    int       length;
+    StartDist start;
+};
+
+// Outcome of one replication
+struct RepResult {
+    long long ticks;
+    bool      complete;
+    int       collisions;       // over all nodes
+    int       failures;         // nodes that gave up
+    double    utilisation;      // share of the run spent on frames that got through
+};
+
+static uint64_t repSeed(uint64_t master, size_t cell, size_t rep) {
+    return mix64(mix64(master) ^ mix64((uint64_t(cell) << 32) | rep));
+}
+
+static RepResult runReplication(const Cell& cell, uint64_t seed) {
+    Rng rng(seed, 0);
+    std::vector<Node> nodes;
+    double at = 1;
+    for (int i = 0; i < cell.nodes; ++i) {
+        int tx;
+        if (cell.start.poisson) {
+            tx = (int)at;
+            double u = (rng() >> 11) * 0x1.0p-53;          // [0, 1)
+            at -= cell.start.width * std::log1p(-u);
+        } else {
+            tx = 1 + (int)rng.below(cell.start.width);
+        }
+        int pos = (int)rng.below(cell.length);
+        nodes.emplace_back(char('a' + i % 26), pos, tx, Rng(seed, i + 1));
+    }
+
+    SimStats stats = run_events(nodes, cell.length);
+    RepResult r = {stats.ticks, stats.complete, 0, 0, 0.0};
+    int delivered = 0;
+    for (const NodeStats& n : stats.nodes) {
+        r.collisions += n.collisions;
+        if (n.success_tick < 0) r.failures++;
+        else delivered++;
+    }
+    if (stats.ticks > 0)
+        r.utilisation = std::min(1.0, 2.0 * cell.length * delivered / stats.ticks);
+    return r;
+}
+
+// Nearest-rank percentile of sorted values
+static long long percentile(const std::vector<long long>& sorted, double p) {
+    if (sorted.empty()) return -1;
+    size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.999999);
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// One line of output for a finished cell
+static std::string summarize(const Cell& cell, const std::vector<RepResult>& reps, bool json) {
+    std::vector<long long> ticks;
+    double ticksSum = 0, collisions = 0, failures = 0, utilisation = 0;
+    for (const RepResult& r : reps) {
+        if (r.complete) {
+            ticks.push_back(r.ticks);
+            ticksSum += r.ticks;
+        }
+        collisions += r.collisions;
+        failures += r.failures;
+        utilisation += r.utilisation;
+    }
+    std::sort(ticks.begin(), ticks.end());
+    double n = reps.size();
+    double mean = ticks.empty() ? -1 : ticksSum / ticks.size();
+
+    std::ostringstream out;
+    if (json) {
+        out << "{\"nodes\":" << cell.nodes << ",\"length\":" << cell.length
+            << ",\"start\":\"" << cell.start.name << "\",\"reps\":" << reps.size()
+            << ",\"complete\":" << ticks.size()
+            << ",\"ticks_mean\":" << mean
+            << ",\"ticks_p50\":" << percentile(ticks, 50)
+            << ",\"ticks_p90\":" << percentile(ticks, 90)
+            << ",\"ticks_p99\":" << percentile(ticks, 99)
+            << ",\"collisions_mean\":" << collisions / n
+            << ",\"failures_mean\":" << failures / n
+            << ",\"utilisation_mean\":" << utilisation / n << "}";
+    } else {
+        out << cell.nodes << "," << cell.length << "," << cell.start.name << ","
+            << reps.size() << "," << ticks.size() << "," << mean << ","
+            << percentile(ticks, 50) << "," << percentile(ticks, 90) << ","
+            << percentile(ticks, 99) << "," << collisions / n << ","
+            << failures / n << "," << utilisation / n;
+    }
+    return out.str();
+}
+
+static bool parseInts(const char* arg, std::vector<int>& out) {
+    out.clear();
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        int v = std::atoi(item.c_str());
+        if (v < 1) return false;
+        out.push_back(v);
+    }
+    return !out.empty();
+}
+
+static bool parseStarts(const char* arg, std::vector<StartDist>& out) {
+    out.clear();
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t colon = item.find(':');
+        if (colon == std::string::npos) return false;
+        std::string kind = item.substr(0, colon);
+        int width = std::atoi(item.c_str() + colon + 1);
+        if (width < 1 || (kind != "uniform" && kind != "poisson")) return false;
+        out.push_back(StartDist{item, kind == "poisson", width});
+    }
+    return !out.empty();
+}
+
+static void usage(const char* name) {
+    std::cerr << "usage: " << name << " [--nodes N,..] [--length L,..]"
+                 " [--start uniform:W|poisson:M,..] [--reps R] [--seed S]"
+                 " [--threads T] [--format csv|json]\n";
+}
+
+int main(int argc, char** argv) {
+    std::vector<int> nodeCounts = {3}, lengths = {MEDIUM_LENGTH};
+    std::vector<StartDist> starts = {StartDist{"uniform:100", false, 100}};
+    int reps = 100;
+    uint64_t seed = 1;
+    int threads = std::max(1, (int)std::thread::hardware_concurrency());
+    bool json = false;
+    for (int i = 1; i < argc; ++i) {
+        bool ok = i + 1 < argc;
+        if (ok && !std::strcmp(argv[i], "--nodes")) ok = parseInts(argv[++i], nodeCounts);
+        else if (ok && !std::strcmp(argv[i], "--length")) ok = parseInts(argv[++i], lengths);
+        else if (ok && !std::strcmp(argv[i], "--start")) ok = parseStarts(argv[++i], starts);
+        else if (ok && !std::strcmp(argv[i], "--reps")) ok = (reps = std::atoi(argv[++i])) > 0;
+        else if (ok && !std::strcmp(argv[i], "--seed")) seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (ok && !std::strcmp(argv[i], "--threads")) ok = (threads = std::atoi(argv[++i])) > 0;
+        else if (ok && !std::strcmp(argv[i], "--format")) {
+            json = !std::strcmp(argv[++i], "json");
+            ok = json || !std::strcmp(argv[i], "csv");
+        } else ok = false;
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Cell> cells;
+    for (int n : nodeCounts)
+        for (int length : lengths)
+            for (const StartDist& start : starts)
+                cells.push_back(Cell{n, length, start});
+
+    // Workers take replications in grid order; the main thread prints each
+    // cell once its last replication is in
+    std::vector<std::vector<RepResult>> results(cells.size(), std::vector<RepResult>(reps));
+    std::vector<int> remaining(cells.size(), reps);
+    std::atomic<size_t> nextJob(0);
+    std::mutex lock;
+    std::condition_variable cellDone;
+    size_t jobs = cells.size() * reps;
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&] {
+            for (size_t job; (job = nextJob++) < jobs;) {
+                size_t c = job / reps, r = job % reps;
+                results[c][r] = runReplication(cells[c], repSeed(seed, c, r));
+                std::lock_guard<std::mutex> guard(lock);
+                if (--remaining[c] == 0) cellDone.notify_one();
+            }
+        });
+    }
+
+    if (json) std::cout << "{\"seed\":" << seed << ",\"cells\":[\n";
+    else std::cout << "# seed " << seed << "\n"
+                      "nodes,length,start,reps,complete,ticks_mean,"
+                      "ticks_p50,ticks_p90,ticks_p99,collisions_mean,"
+                      "failures_mean,utilisation_mean\n";
+    for (size_t c = 0; c < cells.size(); ++c) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cellDone.wait(guard, [&] { return remaining[c] == 0; });
+        }
+        std::cout << summarize(cells[c], results[c], json)
+                  << (json && c + 1 < cells.size() ? "," : "") << std::endl;
+        results[c] = std::vector<RepResult>();
+    }
+    if (json) std::cout << "]}\n";
+
+    for (std::thread& t : pool) t.join();
+    return 0;
+}
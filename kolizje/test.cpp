@@ -1,4 +1,5 @@
 // main.cpp
+#include "csma.h"
 #include <algorithm>
 #include <chrono>
 #include <cstdlib>
@@ -11,41 +12,7 @@
 #include <thread>
 #include <vector>
 #include <string>
-
-constexpr int MEDIUM_LENGTH = 80;
-constexpr int MAX_ATTEMPTS   = 10;
-
-enum class NodeState {
-    IDLE,
-    TRANSMITTING,
-    BACKOFF,
-    JAMMING,
-    SUCCESS
-};
-
-struct Node {
-    char      name;
-    int       position;
-    int       transmission_tick=0;
-    NodeState state    = NodeState::IDLE;
-    int       backoff  = 0;
-    int       attempts = 0;
-    int       jam_start = 0;
-
-    Node(char n, int pos, int tx = -1) : name(n), position(pos) {
-        if (tx < 0) {
-            std::mt19937 rng(std::random_device{}());
-            std::uniform_int_distribution<int> dist(0, 1000);
-            transmission_tick = dist(rng);
-        } else {
-            transmission_tick = tx;//1;
-        }
-    }
-
-    std::string to_string() const {
-        return std::string(1, name) + "(x=" + std::to_string(position) + ")";
-    }
-};
+#include <cstring>
 
 struct Signal {
     int  pos;
@@ -64,7 +31,7 @@ std::vector<Signal> propagate_signal(
     std::vector<Signal> new_signals;
     for (auto& sig : signals) {
         int new_pos = sig.pos + sig.direction;
-        if (0 <= new_pos && new_pos < MEDIUM_LENGTH) {
+        if (0 <= new_pos && new_pos < (int)medium.size()) {
             auto& cell = medium[new_pos];
             if (!cell.has_value()) {
                 cell = std::make_pair(sig.source, 0);
@@ -81,23 +48,34 @@ bool is_medium_idle(const std::vector<Cell>& medium, int pos) {
     return !medium[pos].has_value();
 }
 
-void run_simulation(std::vector<Node>& nodes) {
-    std::vector<Cell> medium(MEDIUM_LENGTH);
+// a node that is idle with its transmission tick behind it never sends again
+bool is_finished(const std::vector<Node>& nodes, int tick) {
+    for (auto& node : nodes) {
+        if (node.state == NodeState::SUCCESS) continue;
+        if (node.state != NodeState::IDLE || node.transmission_tick > tick) return false;
+    }
+    return true;
+}
+
+SimStats run_simulation(std::vector<Node>& nodes, int length, bool playback) {
+    std::vector<Cell> medium(length);
     std::vector<Signal> signals;
     std::vector<std::string> log;
+    std::vector<long long> success_tick(nodes.size(), -1);
     int success = 0;
     int tick = 0;
 
-    while (success < nodes.size()) {
+    while (success < nodes.size() && !is_finished(nodes, tick)) {
         tick++;
         // initialize log line
-        std::string line(MEDIUM_LENGTH, ' ');
+        std::string line(playback ? length : 0, ' ');
 
         // propagate signals
         signals = propagate_signal(medium, signals, tick);
 
         // process each node
-        for (auto& node : nodes) {
+        for (size_t n = 0; n < nodes.size(); ++n) {
+            auto& node = nodes[n];
             if (tick == node.transmission_tick && node.state == NodeState::IDLE) {
                 if (is_medium_idle(medium, node.position)) {
                     medium[node.position] = std::make_pair(node.name, 0);
@@ -113,12 +91,9 @@ void run_simulation(std::vector<Node>& nodes) {
                     // collision
                     node.state = NodeState::JAMMING;
                     if (node.attempts < MAX_ATTEMPTS) {
-                        std::mt19937 rng(std::random_device{}());
-                        int factor = 1 << node.attempts;
-                        std::uniform_int_distribution<int> dist(0, factor-1);
-                        node.backoff = 2 * MEDIUM_LENGTH * dist(rng);
-                        node.transmission_tick = tick + 2*MEDIUM_LENGTH + 1 + node.backoff;
-                        std::cout<<factor<<std::endl;
+                        node.backoff = 2 * length * draw_backoff(node);
+                        node.transmission_tick = tick + 2*length + 1 + node.backoff;
+                        if (playback) std::cout<<(1 << node.attempts)<<std::endl;
                     }
                     else if(node.attempts > MAX_ATTEMPTS+6){
                         node.state = NodeState::IDLE;
@@ -128,8 +103,9 @@ void run_simulation(std::vector<Node>& nodes) {
                     node.jam_start = tick;
                     medium[node.position] = std::make_pair('x', 0);
                 } else {
-                    if (tick >= node.transmission_tick + 2*MEDIUM_LENGTH) {
+                    if (tick >= node.transmission_tick + 2*length) {
                         node.state = NodeState::SUCCESS;
+                        success_tick[n] = tick;
                         success++;
                         medium[node.position] = std::make_pair(node.name, 0);
                     } else {
@@ -139,7 +115,7 @@ void run_simulation(std::vector<Node>& nodes) {
                     }
                 }
             } else if (node.state == NodeState::JAMMING) {
-                if (tick >= node.jam_start + 2*MEDIUM_LENGTH) {
+                if (tick >= node.jam_start + 2*length) {
                     node.state = NodeState::IDLE;
                 } else {
                     medium[node.position] = std::make_pair('x', 0);
@@ -150,15 +126,24 @@ void run_simulation(std::vector<Node>& nodes) {
         }
 
         // build the log line
-        for (int i = 0; i < MEDIUM_LENGTH; ++i) {
-            if (medium[i].has_value()) line[i] = medium[i]->first;
+        if (playback) {
+            for (int i = 0; i < length; ++i) {
+                if (medium[i].has_value()) line[i] = medium[i]->first;
+            }
+            log.push_back(line);
         }
-        log.push_back(line);
 
         // reset medium
         std::fill(medium.begin(), medium.end(), std::nullopt);
     }
 
+    SimStats stats;
+    stats.ticks = tick;
+    stats.complete = success == (int)nodes.size();
+    for (size_t n = 0; n < nodes.size(); ++n)
+        stats.nodes.push_back(NodeStats{nodes[n].name, success_tick[n], nodes[n].attempts});
+    if (!playback) return stats;
+
     // write results
     std::ofstream fout("output.txt");
     for (auto& l : log) fout << l << "\n";
@@ -169,19 +154,53 @@ void run_simulation(std::vector<Node>& nodes) {
         std::cout << l << "\n";
         //std::this_thread::sleep_for(std::chrono::milliseconds(50));
     }
+    return stats;
+}
+
+void print_stats(const SimStats& stats) {
+    std::cout << "ticks: " << stats.ticks
+              << (stats.complete ? "" : " (not every node got through)") << "\n";
+    for (auto& node : stats.nodes) {
+        std::cout << node.name << ": collisions " << node.collisions << ", ";
+        if (node.success_tick < 0) std::cout << "failed\n";
+        else std::cout << "success at tick " << node.success_tick << "\n";
+    }
 }
 
-int main() {
-    std::mt19937 rng(std::random_device{}());
-    std::uniform_int_distribution<int> node_count_dist(3, 3);
-    std::uniform_int_distribution<int> pos_dist(0, MEDIUM_LENGTH - 1);
-    std::uniform_int_distribution<int> tx_dist(0, 100);
+// usage: test [--seed S] [--length N] [--stats] [--events]
+//   --seed    replay the run that printed this seed (default: a fresh one)
+//   --stats   print per-node statistics instead of the medium playback
+//   --events  run the event-driven engine (csma.h); implies --stats
+int main(int argc, char** argv) {
+    uint64_t seed = (uint64_t(std::random_device{}()) << 32) | std::random_device{}();
+    int length = MEDIUM_LENGTH;
+    bool stats = false, events = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--seed") && i + 1 < argc) seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--length") && i + 1 < argc) length = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--stats")) stats = true;
+        else if (!std::strcmp(argv[i], "--events")) events = true;
+        else {
+            std::cerr << "usage: " << argv[0] << " [--seed S] [--length N] [--stats] [--events]\n";
+            return 1;
+        }
+    }
+    if (length < 1) {
+        std::cerr << "length must be positive\n";
+        return 1;
+    }
 
-    int n = node_count_dist(rng);
+    std::cout << "seed " << seed << std::endl;
+    Rng rng(seed, 0);
+    int n = 3;
     std::vector<Node> nodes;
     for (int i = 0; i < n; ++i) {
-        nodes.emplace_back(char('a'+i), pos_dist(rng), tx_dist(rng));
+        int pos = (int)rng.below(length);
+        int tx  = (int)rng.below(101);
+        nodes.emplace_back(char('a'+i), pos, tx, Rng(seed, i + 1));
     }
-    run_simulation(nodes);
+    if (events) print_stats(run_events(nodes, length));
+    else if (stats) print_stats(run_simulation(nodes, length, false));
+    else run_simulation(nodes, length, true);
     return 0;
 }